@@ -0,0 +1,261 @@
+//
+// stack_bench: runs the bundled scripts and generated stress workloads through the
+// lexer and interpreter, with warm-up, repetitions and summary statistics.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <lexer.h>
+#include <interpreter.h>
+#include <perf.h>
+#include <timing.h>
+#include <alloc.h>
+#include <jit.h>
+#include <trace.h>
+#include <ir.h>
+
+#ifndef STACK_SOURCE_DIR
+#define STACK_SOURCE_DIR "."
+#endif
+
+struct workload_t {
+   std::string name;
+   std::string source;
+   // what ? reads see
+   std::string input;
+};
+
+struct engine_t {
+   std::string name;
+   interpreter::runtime_res_t (* run)();
+   // compiles the program after interpreter::reset, timed with it; returns an error message
+   std::string (* prepare)();
+};
+
+struct result_t {
+   std::string workload, engine;
+   u64 bytes, statements, allocations, allocBytes;
+   timing::summary_t lex, reset, run;
+   std::string error, output;
+};
+
+static std::string read_file(ref(std::string) name) {
+   std::ifstream file(std::string(STACK_SOURCE_DIR) + "/" + name);
+   std::stringstream buf;
+   buf << file.rdbuf();
+   return buf.str();
+}
+
+// a counter loop around body, n iterations, using stacks y and z for the counter and condition
+static std::string loop(ref(std::string) label, u64 n, ref(std::string) body) {
+   std::stringstream ss;
+   ss << ">y\n>z\n0 y\n" << label << ":\n" << body
+      << "y 1 y +\ny " << n << " z ==\n!z ^" << label << "\n<z\n<y\n";
+   return ss.str();
+}
+
+static std::vector<workload_t> workloads(u64 scale) {
+   std::vector<workload_t> res;
+   res.push_back({ "beer", read_file("beer.stack"), "" });
+   res.push_back({ "calculator", read_file("calculator.stack"), "3\n+\n4\n" });
+   res.push_back({ "coffee", read_file("coffee.stack"), "latte\nhot\n" });
+
+   // tight integer loop
+   res.push_back({ "int_loop", ">a\n0 a\n" + loop("l", 20000 * scale, "a 3 a +\na 2 a *\na 5 a %\n") + "<a\n", "" });
+
+   // push deep, then pop everything again
+   {
+      std::stringstream ss;
+      ss << ">b\n>c\n0 b\n" << "up:\n>a\nb a\nb 1 b +\nb " << 5000 * scale << " c ==\n!c ^up\n"
+         << "down:\n<a\nb 1 b -\nb 0 c ==\n!c ^down\n<c\n<b\n";
+      res.push_back({ "deep_stack", ss.str(), "" });
+   }
+
+   // string concatenation
+   res.push_back({ "string_build", ">a\n\"\" a\n" + loop("l", 1000 * scale, "a \"ab\" a +\n") + "<a\n", "" });
+
+   // function calls and forward jumps
+   {
+      std::stringstream body;
+      body << "1 ^inc\n1 ^skip1\n\"never\" $\nskip1:\n1 ^skip2\n\"never\" $\nskip2:\n";
+      res.push_back({ "calls_jumps", ">a\n0 a\n>inc\na 1 a +\n<inc\n" + loop("l", 10000 * scale, body.str()) + "<a\n",
+                      "" });
+   }
+
+   // large straight-line source, mostly lexer and reset work
+   {
+      std::stringstream ss;
+      ss << ">a\n>b\n0 a\n`generated`\n";
+      for (u64 i = 0; i < 20000 * scale; i++) {
+         ss << "a " << i % 97 << " a +; a 1.5 b *\n\"lex\" b (string)\nb \"x\" b ==\n";
+      }
+      ss << "<b\n<a\n";
+      res.push_back({ "large_source", ss.str(), "" });
+   }
+   return res;
+}
+
+// forgets the previous program's traces
+static std::string prepare_trace() {
+   trace::reset(interpreter::statements.size());
+   return "";
+}
+
+// rewrites the program with every ir pass
+static std::string prepare_optimised() {
+   ir::optimise();
+   return "";
+}
+
+// runs one workload once, returns phase times in ns; stdout is captured into output and stdin scripted
+static std::string run_once(ref(workload_t) work, ref(engine_t) engine, f64* times, mutref(std::string) output) {
+   std::stringstream in(work.input), out;
+   std::streambuf* oldIn = std::cin.rdbuf(in.rdbuf());
+   std::streambuf* oldOut = std::cout.rdbuf(out.rdbuf());
+
+   u64 start = timing::wall_ns();
+   lexer::reset(work.source);
+   auto toks = lexer::lex();
+   u64 lexed = timing::wall_ns();
+   interpreter::reset(toks);
+   std::string prepared = engine.prepare ? engine.prepare() : "";
+   u64 resetted = timing::wall_ns();
+   interpreter::runtime_res_t res = prepared.empty() ? engine.run() : interpreter::runtime_res_t { { }, prepared };
+   u64 ran = timing::wall_ns();
+
+   std::cin.rdbuf(oldIn);
+   std::cout.rdbuf(oldOut);
+   output = out.str();
+   times[0] = (f64) (lexed - start);
+   times[1] = (f64) (resetted - lexed);
+   times[2] = (f64) (ran - resetted);
+   return lexer::error.empty() ? res.second : lexer::error;
+}
+
+// a single untimed run on the interpreter, counting statements and allocations and recording the output
+// every engine has to reproduce
+static void count(ref(workload_t) work, mutref(result_t) r) {
+   perf::count_policy_t::executed = 0;
+   alloc::reset();
+   engine_t counting { "count", interpreter::run_with<perf::count_policy_t> };
+   f64 times[3];
+   run_once(work, counting, times, r.output);
+   r.statements = perf::count_policy_t::executed;
+   for (ref(alloc::site_stats_t) it : alloc::sites) {
+      r.allocations += it.count;
+      r.allocBytes += it.bytes;
+   }
+}
+
+static void json_summary(mutref(std::ostream) out, ref(timing::summary_t) s) {
+   out << "{\"min\": " << s.min << ", \"median\": " << s.median << ", \"mean\": " << s.mean
+       << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << ", \"stddev\": " << s.stddev << "}";
+}
+
+static void write_json(mutref(std::ostream) out, ref(std::vector<result_t>) results, u32 reps, u32 warmup) {
+   out << "{\n  \"unit\": \"ns\",\n  \"repetitions\": " << reps << ",\n  \"warmup\": " << warmup
+       << ",\n  \"results\": [\n";
+   for (u32 i = 0; i < results.size(); i++) {
+      ref(result_t) r = results[i];
+      out << "    {\"workload\": \"" << r.workload << "\", \"engine\": \"" << r.engine << "\", \"bytes\": " << r.bytes
+          << ", \"statements\": " << r.statements << ", \"allocations\": " << r.allocations
+          << ", \"alloc_bytes\": " << r.allocBytes << ", \"error\": \"" << replace_all(r.error, "\"", "'") << "\",\n"
+          << "     \"lex\": ";
+      json_summary(out, r.lex);
+      out << ",\n     \"reset\": ";
+      json_summary(out, r.reset);
+      out << ",\n     \"run\": ";
+      json_summary(out, r.run);
+      out << ",\n     \"statements_per_sec\": "
+          << (r.run.median == 0 ? 0 : (f64) r.statements / (r.run.median / 1e9)) << "}"
+          << (i + 1 == results.size() ? "\n" : ",\n");
+   }
+   out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+   u32 reps = 10, warmup = 2;
+   u64 scale = 1;
+   std::string filter, jsonPath, engineName = "interp";
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+         reps = std::strtoul(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+         warmup = std::strtoul(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--scale") && i + 1 < argc) {
+         scale = std::strtoull(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+         filter = argv[++i];
+      } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+         jsonPath = argv[++i];
+      } else if (!strcmp(argv[i], "--engine") && i + 1 < argc) {
+         engineName = argv[++i];
+      } else {
+         std::cerr << "usage: stack_bench [--reps N] [--warmup N] [--scale N] [--filter name] "
+                      "[--engine name] [--json path|-]\n";
+         return 1;
+      }
+   }
+
+   std::vector<engine_t> engines = {
+         { "interp", interpreter::run },
+         { "jit", jit::run, jit::compile },
+         { "trace", interpreter::run_with<trace::policy_t>, prepare_trace },
+         { "opt", interpreter::run, prepare_optimised },
+   };
+   std::vector<engine_t> selected;
+   for (ref(engine_t) it : engines) {
+      if (engineName == "all" || engineName == it.name) {
+         selected.push_back(it);
+      }
+   }
+   if (selected.empty()) {
+      std::cerr << "stack_bench: unknown engine " << engineName << '\n';
+      return 1;
+   }
+
+   std::vector<result_t> results;
+   for (ref(workload_t) work : workloads(scale)) {
+      if (!filter.empty() && work.name.find(filter) == std::string::npos) {
+         continue;
+      }
+      for (ref(engine_t) engine : selected) {
+         result_t r { work.name, engine.name, work.source.size() };
+         count(work, r);
+         std::vector<f64> lex, reset, run;
+         f64 times[3];
+         std::string output;
+         for (u32 i = 0; i < warmup + reps && r.error.empty(); i++) {
+            r.error = run_once(work, engine, times, output);
+            if (r.error.empty() && output != r.output) {
+               r.error = "output differs from the interpreter's";
+            }
+            if (i < warmup) {
+               continue;
+            }
+            lex.push_back(times[0]);
+            reset.push_back(times[1]);
+            run.push_back(times[2]);
+         }
+         r.lex = timing::summarize(lex);
+         r.reset = timing::summarize(reset);
+         r.run = timing::summarize(run);
+         results.push_back(r);
+
+         std::cerr << work.name << " [" << engine.name << "] run median " << r.run.median / 1e3 << "us (min "
+                   << r.run.min / 1e3 << ", p99 " << r.run.p99 / 1e3 << ", sd " << r.run.stddev / 1e3 << "), lex median "
+                   << r.lex.median / 1e3 << "us, " << r.statements << " statements, " << r.allocations << " allocations"
+                   << (r.error.empty() ? "" : ", error: " + r.error) << '\n';
+      }
+   }
+
+   if (jsonPath == "-") {
+      write_json(std::cout, results, reps, warmup);
+   } else if (!jsonPath.empty()) {
+      std::ofstream out(jsonPath);
+      write_json(out, results, reps, warmup);
+   }
+   return 0;
+}
@@ -0,0 +1,84 @@
+//
+// Allocation accounting for the interpreter, every value allocation goes through alloc::make.
+//
+
+#ifndef STACK_ALLOC_H
+#define STACK_ALLOC_H
+
+#include <string>
+#include <ostream>
+#include <utility>
+#include <global.h>
+
+namespace alloc {
+   // what an allocation is for
+   enum site_e {
+      literal,
+      arithmetic,
+      conversion,
+      comparison,
+      read,
+      array_growth,
+      program,
+      site_count
+   };
+
+   std::string to_string(site_e in);
+
+   struct site_stats_t {
+      u64 count, bytes, freed;
+   };
+
+   // counted per thread, parallel::map hands what its workers counted to the thread that called it
+   extern thread_local site_stats_t sites[site_count];
+   // bytes currently allocated through make/grow and not yet released, and the most there ever were
+   extern thread_local u64 live, peak;
+   // when set, interpreter::run prints the report before returning
+   extern bool reporting;
+
+   // heap bytes owned by a value, beyond the object itself
+   template<typename t>
+   inline u64 heap_bytes(ref(t)) { return 0; }
+   template<>
+   inline u64 heap_bytes(ref(std::string) in) {
+      return in.capacity() > 15 ? in.capacity() + 1 : 0;
+   }
+
+   inline void record(site_e site, u64 bytes) {
+      sites[site].count++;
+      sites[site].bytes += bytes;
+      live += bytes;
+      if (live > peak) {
+         peak = live;
+      }
+   }
+
+   inline void release(site_e site, u64 bytes) {
+      sites[site].freed += bytes;
+      live -= bytes;
+   }
+
+   // new t(args...), accounted to site
+   template<typename t, typename... args_t>
+   inline t* make(site_e site, args_t&&... args) {
+      t* res = new t(std::forward<args_t>(args)...);
+      record(site, sizeof(t) + heap_bytes(*res));
+      return res;
+   }
+
+   // accounts for a container growing from one capacity to another
+   inline void grow(u64 fromBytes, u64 toBytes) {
+      if (toBytes > fromBytes) {
+         record(array_growth, toBytes - fromBytes);
+      }
+   }
+
+   void reset();
+   // adds counts made on another thread to this thread's, and clears them
+   void absorb(mutptr(site_stats_t) from, mutref(u64) fromLive);
+   // peak resident set size of the process in bytes, 0 if unknown
+   u64 peak_rss();
+   void report(mutref(std::ostream) out);
+}
+
+#endif //STACK_ALLOC_H
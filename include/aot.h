@@ -0,0 +1,19 @@
+//
+// Ahead-of-time compilation of a reset program to a standalone C++ translation unit.
+//
+
+#ifndef STACK_AOT_H
+#define STACK_AOT_H
+
+#include <string>
+#include <ostream>
+#include <interpreter.h>
+
+namespace aot {
+   // writes a C++ translation unit equivalent to interpreter::statements, which links against stack_core.
+   // source is the program's text, which the generated code re-resets at startup for the statements its
+   // runtime calls need, running ir::optimise on them again when optimised. returns an error message on failure
+   std::string emit(mutref(std::ostream) out, ref(std::string) source, ref(std::string) name, bool optimised);
+}
+
+#endif //STACK_AOT_H
@@ -0,0 +1,40 @@
+//
+// Batch mode: one program run over many inputs at once, a lane per input, in lockstep.
+//
+
+#ifndef STACK_BATCH_H
+#define STACK_BATCH_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <global.h>
+#include <interpreter.h>
+
+namespace batch {
+   struct stats_t {
+      // inputs run and batches they ran in, statements dispatched for a group of lanes at the same one,
+      // the lanes those ran for, and dispatches done as one operation over the whole group
+      u64 inputs, batches, dispatches, laneStatements, vectorised;
+   };
+
+   extern stats_t stats;
+
+   // what the program printed for an input, and the error it failed with, empty when it did not
+   struct result_t {
+      std::string output, error;
+   };
+
+   // empty when every statement of the loaded program can run in a batch, why not otherwise. maps,
+   // reductions, channels and coroutines cannot
+   std::string supported();
+   // runs the loaded program once for every input, lanes inputs at a time, an input being everything its
+   // reads read. every lane has stacks and a jump back stack of its own, and the lanes at the same
+   // statement run it together, arithmetic on numbers as one operation over all of them. results are
+   // the same as running the program on each input alone
+   std::vector<result_t> run(ref(std::vector<std::string>) inputs, u32 lanes);
+
+   void report(mutref(std::ostream) out);
+}
+
+#endif //STACK_BATCH_H
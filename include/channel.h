@@ -0,0 +1,27 @@
+//
+// Channels between functions of a program running at once, each on a thread of its own.
+//
+
+#ifndef STACK_CHANNEL_H
+#define STACK_CHANNEL_H
+
+#include <string>
+#include <global.h>
+#include <interpreter.h>
+
+namespace channel {
+   // values a channel holds before sending to it waits for room
+   const u32 capacity = 1024;
+
+   // `x }c` sends x to channel c, waiting while it is full
+   interpreter::runtime_res_t send(ref(interpreter::statement_t) stmt);
+   // `a {c` receives the oldest value sent to channel c onto the top of a, waiting while there is none
+   interpreter::runtime_res_t receive(ref(interpreter::statement_t) stmt);
+   // `~name` starts the function name running on a thread of its own, on a copy of the stacks
+   interpreter::runtime_res_t spawn(ref(interpreter::statement_t) stmt);
+   // waits for every stage spawned to finish, handing back the error of the first one to fail, which
+   // cancels the others. cancel makes the stages waiting on a channel give up too
+   interpreter::runtime_res_t join(bool cancel);
+}
+
+#endif //STACK_CHANNEL_H
@@ -0,0 +1,40 @@
+//
+// Coroutines: functions that run a piece at a time, taking turns with whoever resumes them on one thread.
+//
+
+#ifndef STACK_COROUTINE_H
+#define STACK_COROUTINE_H
+
+#include <string>
+#include <global.h>
+#include <interpreter.h>
+#include <parallel.h>
+
+namespace coroutine {
+   // `g :name` makes a coroutine of the function name, on a copy of the stacks as they are, and sets the
+   // top of g to its handle. it does not run until resumed
+   interpreter::runtime_res_t create(ref(interpreter::statement_t) stmt);
+   // `g x (resume)` runs the coroutine whose handle is on top of g until it yields, setting the top of x
+   // to what it yielded. once it returns instead, x is left alone and the coroutine is done
+   interpreter::runtime_res_t resume(ref(interpreter::statement_t) stmt);
+   // `x (yield)` hands x to whoever resumed the coroutine running, which carries on from the next
+   // statement when resumed again
+   interpreter::runtime_res_t yield(ref(interpreter::statement_t) stmt);
+   // `g d (done)` sets the top of d to true once the coroutine whose handle is on top of g has returned,
+   // false before that
+   interpreter::runtime_res_t done(ref(interpreter::statement_t) stmt);
+
+   // coroutines belong to the thread making them. the ones made after mark are dropped by release, so
+   // those a mapped or spawned function makes end with it
+   u64 mark();
+   void release(u64 from);
+   // drops this thread's coroutines of the program it is running, before it is replaced
+   void reset();
+
+   // policy a coroutine runs under, the only one where a yield stops the run
+   struct policy_t : parallel::worker_policy_t {
+      static const bool yields = true;
+   };
+}
+
+#endif //STACK_COROUTINE_H
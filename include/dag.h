@@ -0,0 +1,52 @@
+//
+// Straight-line regions of statements run in parallel, as far as the stacks they use let them, hooked into
+// interpreter::run_with as a policy.
+//
+
+#ifndef STACK_DAG_H
+#define STACK_DAG_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <global.h>
+#include <interpreter.h>
+#include <ir.h>
+
+namespace dag {
+   // runs of a region timed on one thread before deciding whether it runs in parallel
+   const u32 samples = 3;
+   // nanoseconds a region has to take on one thread, on average, to be run in parallel
+   const u64 min_ns = 20000;
+
+   struct stats_t {
+      // regions with statements that can run at once, of those the ones worth running in parallel, the
+      // times one ran in parallel and the statements run on other threads meanwhile
+      u64 regions, parallel, runs, statements;
+   };
+
+   extern stats_t stats;
+   // region starting at each statement, ir::none when none does
+   extern std::vector<u32> starting;
+
+   // finds the regions of interpreter::statements: runs of operations, sets, casts, pushes, pops, prints
+   // and reads entered only at their first statement. a statement depends on the ones before it using a
+   // stack it writes or writing one it uses, and prints and reads on everything before them, so output
+   // and input keep their order. regions where two statements that can handle strings or arrays do not
+   // depend on each other are kept
+   void analyse();
+   // runs the region starting at current, false when it is not worth running in parallel and the
+   // interpreter should run it instead. otherwise current is moved past it, and error set to what the
+   // first failing statement failed with, every statement before that having run
+   bool run(mutref(u32) current, mutref(std::string) error);
+   void report(mutref(std::ostream) out);
+
+   // policy running regions in parallel
+   struct policy_t : interpreter::no_policy_t {
+      static inline bool region(mutref(u32) current, mutref(std::string) error) {
+         return current < starting.size() && starting[current] != ir::none && dag::run(current, error);
+      }
+   };
+}
+
+#endif //STACK_DAG_H
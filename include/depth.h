@@ -0,0 +1,43 @@
+//
+// Static stack-depth analysis of interpreter::statements, proving which stack accesses can never find
+// their stack empty.
+//
+
+#ifndef STACK_DEPTH_H
+#define STACK_DEPTH_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <global.h>
+#include <interpreter.h>
+
+namespace depth {
+   // no upper bound on a depth
+   const u32 unbounded = UINT32_MAX;
+
+   // the fewest and most values a stack can hold
+   struct range_t {
+      u32 lo, hi;
+   };
+
+   // ranges of the a-z stacks, then the jump back stack
+   typedef std::array<range_t, interpreter::jump_back + 1> depths_t;
+
+   struct stats_t {
+      // stack accesses in reachable statements, and how many of them are proven safe
+      u32 accesses, proven;
+   };
+
+   extern stats_t stats;
+   // the depths just before every statement, and whether the analysis found a way to reach it
+   extern std::vector<depths_t> before;
+   extern std::vector<bool> reached;
+
+   // analyses interpreter::statements, marking the statements whose accesses are all safe in
+   // interpreter::proven. returns the accesses that always find their stack empty, one per line with
+   // its source position, empty when there are none
+   std::string analyse();
+}
+
+#endif //STACK_DEPTH_H
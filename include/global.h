@@ -32,6 +32,7 @@ typedef unsigned long long u64;
 typedef unsigned int u32;
 typedef long long i64;
 typedef int i32;
+typedef unsigned char u8;
 typedef double f64;
 typedef float f32;
 
@@ -34,12 +34,97 @@ namespace interpreter {
    typedef std::vector<node_t> statement_t;
    typedef std::pair<data_t, std::string> runtime_res_t;
 
-   extern stack_t * stacks;
+   // every thread running statements has stacks and a jump back stack of its own, see parallel::map
+   extern thread_local stack_t * stacks;
    extern std::vector<statement_t> statements;
+   // source position of the first token of each statement
+   extern std::vector<lexer::file_pos_t> positions;
+   // statements depth::analyse proved never find a stack they use empty, which skip checking for it.
+   // empty until the program is analysed
+   extern std::vector<bool> proven;
+
+   // 0-25 a-z, 26 jump back
+   const u32 jump_back = 26;
+   // the jump back stack: return addresses taken jumps push and endf pops
+   extern thread_local std::vector<u32> returns;
+
+   // execution policy that does nothing, every hook compiles away
+   struct no_policy_t {
+      // runs a function for parallel::map off the main program, where what depth::analyse proved does
+      // not hold, so every statement checks its stacks. nothing is reported at the end
+      static const bool worker = false;
+      // runs a coroutine, which a yield stops
+      static const bool yields = false;
+      // runs a session a step at a time, stopping whenever suspend says to, see session::step
+      static const bool suspends = false;
+      // true stops the run before the statement at, to carry on from it later
+      static inline bool suspend(u32) { return false; }
+      static inline u64 begin(u32) { return 0; }
+      static inline void end(u32, u64) { }
+      // a jump from one statement back to an earlier one was taken, current is the target. may move
+      // current on, setting error when the code it ran on the way failed
+      static inline void back_edge(u32, mutref(u32), mutref(std::string)) { }
+      // a jump at the statement was taken and is about to call. true when the policy did the call itself,
+      // and the jump only moves on to the next statement
+      static inline bool call(u32) { return false; }
+      // an endf just popped a return address
+      static inline void returned() { }
+      // current may start a run of statements the policy runs itself. true when it did, having moved
+      // current past them and set error if they failed
+      static inline bool region(mutref(u32), mutref(std::string)) { return false; }
+   };
 
    bool is_true(ref(data_t));
    void reset(ref(std::vector<lexer::tok_t>));
+
+   // semantics of a single statement, shared by run and the compiled engines. unchecked, they assume
+   // every stack the statement uses holds something
+   template<bool checked = true>
+   runtime_res_t exec_op(ref(statement_t));
+   template<bool checked = true>
+   runtime_res_t exec_print(ref(statement_t));
+   template<bool checked = true>
+   runtime_res_t exec_set(ref(statement_t));
+   template<bool checked = true>
+   runtime_res_t exec_cast(ref(statement_t));
+   template<bool checked = true>
+   runtime_res_t exec_read(ref(statement_t));
+   // an operator applied to two values and a value converted to a type, as statements do them
+   runtime_res_t compute(lexer::tok_type_e op, data_t one, data_t two);
+   runtime_res_t convert_to(data_t in, data_type_e to);
+   // value of a jump's (possibly negated) condition
+   template<bool checked = true>
+   runtime_res_t exec_cond(ref(statement_t));
+   // value of a literal, or the top of a stack, failing when it is empty
+   runtime_res_t value_of(ref(node_t));
+   // pops a stack, failing when it is empty
+   runtime_res_t exec_pop(ref(statement_t));
+   // a taken jump right before an endf pushes no return address, as returning to the endf would only
+   // return again. this keeps tail calls and loops ending functions in constant space
+   inline bool tail_call(u32 stmt) {
+      if (stmt + 1 >= statements.size()) {
+         return false;
+      }
+      ref(statement_t) next = statements[stmt + 1];
+      return next[next.size() - 1].type == lexer::endf;
+   }
+   // pushes a return address onto the jump back stack, and pops one off it
+   void push_return(u32 to);
+   template<bool checked = true>
+   runtime_res_t pop_return(mutref(u32) to);
+
+   // runs the program, calling policy_t::begin/end around every statement
+   template<typename policy_t>
+   runtime_res_t run_with();
    runtime_res_t run();
+   // runs from statement at on the jump back stack given until the program ends or, under a policy that
+   // yields, a yield, leaving at where it stopped. where the thread was in the program is kept
+   template<typename policy_t>
+   runtime_res_t run_from(mutref(u32) at, mutref(std::vector<u32>) jumpBacks);
+   // runs the function whose body starts at entry on this thread's stacks until it returns, under
+   // parallel::worker_policy_t. where the thread was in the program is kept, the coroutines the function
+   // made are not
+   runtime_res_t call(u32 entry);
 }
 
 #endif //STACK_INTERPRETER_H
@@ -0,0 +1,49 @@
+//
+// Asynchronous stdin and stdout, so reads and prints do not wait on the file descriptors.
+//
+
+#ifndef STACK_IO_H
+#define STACK_IO_H
+
+#include <string>
+#include <ostream>
+#include <global.h>
+
+namespace io {
+   enum backend_e {
+      // std::cin and std::cout as they were
+      off,
+      // reads and writes submitted to an io_uring, running while the program does
+      uring,
+      // plain read and write in large blocks, when there is no io_uring to use
+      blocking
+   };
+
+   struct stats_t {
+      u64 bytesIn, bytesOut, reads, writes;
+      // nanoseconds spent waiting for input to arrive, and for output to be written out
+      u64 inputWait, outputWait;
+   };
+
+   extern stats_t stats;
+   extern backend_e backend;
+
+   // bytes moved by one read or write
+   const u32 chunk = 1 << 17;
+   // output buffers, the program fills one while the others wait to be written or are being written
+   const u32 out_buffers = 4;
+
+   // points std::cin and std::cout at buffers over fds 0 and 1, falling back to the blocking backend when
+   // wanted is uring and there is none. input is read a chunk ahead of what the program has used, and
+   // output written a chunk at a time. reads are expected on one thread at a time, prints can come from
+   // any
+   backend_e start(backend_e wanted);
+   // writes out everything printed and gives std::cin and std::cout their own buffers back. backend is
+   // left as it was, for the report
+   void stop();
+
+   std::string to_string(backend_e in);
+   void report(mutref(std::ostream) out);
+}
+
+#endif //STACK_IO_H
@@ -0,0 +1,112 @@
+//
+// Control-flow graph and SSA form over the statements produced by interpreter::reset, and the passes
+// that rewrite interpreter::statements from them.
+//
+
+#ifndef STACK_IR_H
+#define STACK_IR_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <ostream>
+#include <global.h>
+#include <interpreter.h>
+
+namespace ir {
+   // no block, no value
+   const u32 none = UINT32_MAX;
+
+   // statements [first, last), a jump, beginf or endf can only be the last of them
+   struct block_t {
+      u32 first, last;
+      std::vector<u32> succs, preds;
+      // immediate dominator, none for the entry and unreachable blocks
+      u32 idom;
+      bool reachable;
+   };
+
+   enum value_kind_e {
+      // whatever the stack held when the block was entered, for the entry and unreachable blocks
+      unknown,
+      phi,
+      // written by a statement
+      defined
+   };
+
+   // one version of the top of one of the a-z stacks
+   struct value_t {
+      value_kind_e kind;
+      u32 stack;
+      // defined: the statement, phi: the block
+      u32 at;
+      // phi: the value coming from each of the block's preds, in order
+      std::vector<u32> args;
+      // values with the same number hold the same data
+      u32 vn;
+   };
+
+   typedef std::array<u32, 26> tops_t;
+
+   struct program_t {
+      std::vector<block_t> blocks;
+      // block of every statement
+      std::vector<u32> blockOf;
+      std::vector<value_t> values;
+      // phi values at the start of every block
+      std::vector<std::vector<u32>> phis;
+      // the value on top of every stack just before every statement
+      std::vector<tops_t> tops;
+      // the value a statement leaves on top of the stack it writes, none if it writes none
+      std::vector<u32> defs;
+      // stacks that can ever hold an array, over the whole program
+      bool arrays[26];
+   };
+
+   extern program_t program;
+
+   // what the passes did
+   struct stats_t {
+      u32 inlined, numbered, hoisted, propagated, folded, eliminated, unreachable;
+   };
+
+   extern stats_t stats;
+   // longest function body inline_calls copies into a call, 0 turning inlining off
+   extern u32 inline_limit;
+
+   // is op one of the operators exec_op handles
+   bool is_op(lexer::tok_type_e op);
+   // the stack whose top a statement writes, pushes or pops, none if it does not touch one
+   u32 written(ref(interpreter::statement_t) stmt);
+   // the nodes a statement reads values from, stack or literal
+   std::vector<u32> operands(ref(interpreter::statement_t) stmt);
+   // statements a statement can carry on to, statements.size() being the end of the program. a jump on
+   // a literal only goes one way
+   std::vector<u32> successors(u32 stmt);
+   // the literal a value is known to equal, false if it is not known
+   bool constant(u32 value, mutref(interpreter::node_t) out);
+
+   // builds the CFG, dominator tree and SSA form of interpreter::statements
+   void build();
+   // replaces calls that are always taken by a copy of the function's body, when the body is no longer
+   // than inline_limit and runs straight from its first statement to endf, so the call's return address
+   // is the one endf pops
+   u32 inline_calls();
+   // global value numbering, statements recomputing a value another stack already holds become copies
+   u32 gvn();
+   // loop-invariant code motion, statements in a loop header recomputing the same value every iteration
+   // move in front of the loop
+   u32 licm();
+   // replaces stack operands holding known literals by those literals, and operations and casts on
+   // literals by their results, computed by interpreter::compute and convert_to
+   u32 fold();
+   // turns copies nothing reads into nops, then drops nops, labels, jumps never taken and unreachable
+   // statements
+   u32 eliminate();
+   // runs every pass, leaving program built for the final statements
+   void optimise();
+   // the blocks, phis and values, for --dump-ir
+   void dump(mutref(std::ostream) out);
+}
+
+#endif //STACK_IR_H
@@ -0,0 +1,22 @@
+//
+// Baseline template JIT, translates interpreter::statements into x86-64 machine code.
+//
+
+#ifndef STACK_JIT_H
+#define STACK_JIT_H
+
+#include <string>
+#include <interpreter.h>
+
+namespace jit {
+   // can this build generate code for the host (linux x86-64)
+   bool supported();
+   // translates the statements produced by interpreter::reset, returns an error message on failure
+   std::string compile();
+   // runs the compiled program, the same way interpreter::run would
+   interpreter::runtime_res_t run();
+   // frees the compiled code
+   void release();
+}
+
+#endif //STACK_JIT_H
@@ -49,6 +49,15 @@ namespace lexer {
       or_,
       xor_,
       cast,
+      map,
+      reduce,
+      send,
+      receive,
+      spawn,
+      coroutine,
+      resume,
+      yield,
+      done,
       nop
    };
 
@@ -59,7 +68,8 @@ namespace lexer {
          "beginf", "endf", "print", "jump", "id",
          "stack", "str", "chr", "integer", "fp", "eq",
          "neq", "read", "comma", "dot", "begina",
-         "enda", "label", "array", "not", "and", "or", "xor", "cast", "nop"
+         "enda", "label", "array", "not", "and", "or", "xor", "cast", "map", "reduce", "send", "receive", "spawn",
+         "coroutine", "resume", "yield", "done", "nop"
       }[in];
    }
 
@@ -0,0 +1,44 @@
+//
+// Memoization of pure beginf/endf functions, hooked into interpreter::run_with as a policy.
+//
+
+#ifndef STACK_MEMO_H
+#define STACK_MEMO_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <global.h>
+#include <interpreter.h>
+
+namespace memo {
+   struct stats_t {
+      // pure functions found, calls answered from the cache, calls that ran and were cached
+      u64 pure, hits, misses, stored;
+   };
+
+   extern stats_t stats;
+
+   // finds the pure functions of interpreter::statements and forgets every cached result
+   void reset();
+   // a jump at stmt was taken. true when it calls a pure function whose result for the stack tops it
+   // reads is cached, in which case those results are on the stacks and the call is done
+   bool call(u32 stmt);
+   // an endf returned, caching the results of the calls it finished
+   void returned();
+   // prints the counters and the pure functions
+   void report(mutref(std::ostream) out);
+
+   // memoizing policy for interpreter::run_with
+   struct policy_t : interpreter::no_policy_t {
+      static inline bool call(u32 stmt) {
+         return memo::call(stmt);
+      }
+
+      static inline void returned() {
+         memo::returned();
+      }
+   };
+}
+
+#endif //STACK_MEMO_H
@@ -0,0 +1,42 @@
+//
+// Work-stealing pool of threads, and the parallel map over arrays running on it.
+//
+
+#ifndef STACK_PARALLEL_H
+#define STACK_PARALLEL_H
+
+#include <string>
+#include <functional>
+#include <global.h>
+#include <interpreter.h>
+
+namespace parallel {
+   // threads work runs on, the one calling it included. 0 runs one per hardware thread
+   extern u32 threads;
+
+   struct stats_t {
+      // maps run, elements mapped, ranges of elements stolen from another thread
+      u64 maps, elements, steals;
+   };
+
+   extern stats_t stats;
+
+   // threads work is spread over at most
+   u32 width();
+   // runs work(who, idx) for every idx in [0, size), who being the thread running it, below width().
+   // threads running out of indices steal them from the others. runs on this thread alone when it is
+   // already running work for each, or another thread is using the pool
+   void each(u32 size, ref(std::function<void(u32, u32)>) work);
+
+   // runs `src dst @name`: every element of the array on top of src is put on top of src in a private
+   // copy of the stacks, the function name runs on it, and what it leaves on top of dst becomes that
+   // element of a new array set on top of dst
+   interpreter::runtime_res_t map(ref(interpreter::statement_t) stmt);
+
+   // policy the functions a map applies run under
+   struct worker_policy_t : interpreter::no_policy_t {
+      static const bool worker = true;
+   };
+}
+
+#endif //STACK_PARALLEL_H
@@ -0,0 +1,60 @@
+//
+// Hardware performance counters around the lex, reset and run phases, via perf_event_open.
+//
+
+#ifndef STACK_PERF_H
+#define STACK_PERF_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <global.h>
+#include <interpreter.h>
+
+namespace perf {
+   enum counter_e {
+      cycles,
+      instructions,
+      branch_misses,
+      cache_misses,
+      page_faults,
+      counter_count
+   };
+
+   std::string to_string(counter_e in);
+
+   // one reading per counter, available is false when the counter could not be opened
+   struct sample_t {
+      u64 values[counter_count];
+      bool available[counter_count];
+   };
+
+   // a named phase and what the counters read over it
+   struct phase_t {
+      std::string name;
+      sample_t sample;
+      u64 statements;
+   };
+
+   extern std::vector<phase_t> phases;
+
+   // opens the counters for this process, returns false when none of them could be opened
+   bool open();
+   void close();
+   // starts counting from zero
+   void begin();
+   // stops counting and records the phase, statements is how many statements it executed (0 if n/a)
+   void end(ref(std::string) name, u64 statements = 0);
+   // prints every recorded phase with IPC and per-statement figures
+   void report(mutref(std::ostream) out);
+
+   // execution policy that only counts executed statements, for the per-statement figures
+   struct count_policy_t : interpreter::no_policy_t {
+      static u64 executed;
+
+      static inline u64 begin(u32) { return 0; }
+      static inline void end(u32, u64) { executed++; }
+   };
+}
+
+#endif //STACK_PERF_H
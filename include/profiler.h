@@ -0,0 +1,67 @@
+//
+// Per-statement execution profiler, hooked into interpreter::run_with as a policy.
+//
+
+#ifndef STACK_PROFILER_H
+#define STACK_PROFILER_H
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <global.h>
+#include <interpreter.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <ctime>
+#endif
+
+namespace profiler {
+   // execution count and accumulated ticks of a single statement
+   struct stmt_stats_t {
+      u64 count, ticks;
+   };
+
+   // indexed by statement number, sized by reset(u32)
+   extern std::vector<stmt_stats_t> stats;
+
+   // rdtsc where available, monotonic nanoseconds otherwise
+   inline u64 now() {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      timespec ts { };
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+   }
+
+   // unit of now(), for the report header
+   inline const char* tick_unit() {
+#if defined(__x86_64__) || defined(__i386__)
+      return "cycles";
+#else
+      return "ns";
+#endif
+   }
+
+   // profiling policy for interpreter::run_with, every statement is counted and timed
+   struct policy_t : interpreter::no_policy_t {
+      static inline u64 begin(u32) {
+         return now();
+      }
+
+      static inline void end(u32 stmt, u64 start) {
+         stmt_stats_t& it = stats[stmt];
+         it.count++;
+         it.ticks += now() - start;
+      }
+   };
+
+   // clears the stats for a program of stmts statements
+   void reset(u32 stmts);
+   // hottest source lines first, at most top of them, optionally followed by the annotated source
+   void report(mutref(std::ostream) out, u32 top, bool annotate);
+}
+
+#endif //STACK_PROFILER_H
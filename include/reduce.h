@@ -0,0 +1,35 @@
+//
+// Builtin reductions and sort over arrays, split over parallel::each for large ones.
+//
+
+#ifndef STACK_REDUCE_H
+#define STACK_REDUCE_H
+
+#include <string>
+#include <global.h>
+#include <interpreter.h>
+
+namespace reduce {
+   enum kind_e {
+      sum,
+      product,
+      min,
+      max,
+      count,
+      sort
+   };
+
+   kind_e kind_of(ref(std::string) name);
+
+   // elements worked on at a time. arrays of one block are reduced on the calling thread, and larger
+   // ones a block per parallel::each index, the blocks' results combined in order so they do not
+   // depend on how many threads there are
+   const u32 block = 1 << 14;
+
+   // runs `src dst (kind)`, setting the top of dst to the kind of reduction of the array on top of src:
+   // the sum or product of its numbers, its least or greatest number, how many of its elements are
+   // true, or a new array of its numbers or strings in ascending order
+   interpreter::runtime_res_t exec(ref(interpreter::statement_t) stmt);
+}
+
+#endif //STACK_REDUCE_H
@@ -0,0 +1,92 @@
+//
+// Programs run a slice at a time, so one thread can take turns between many of them.
+//
+
+#ifndef STACK_SESSION_H
+#define STACK_SESSION_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <global.h>
+#include <interpreter.h>
+
+namespace session {
+   enum status_e {
+      // stopped by its budget, stepping again carries on
+      ready,
+      // stopped at a read with no whole word of input to give it, until fed or closed
+      waiting,
+      finished,
+      failed
+   };
+
+   // how long a step runs at most, 0 being no limit. a statement is never cut short, so a map, reduction
+   // or resume runs whole
+   struct budget_t {
+      u64 statements, micros;
+   };
+
+   // a loaded program and everything about where it is, swapped in for the interpreter's while it steps
+   struct session_t {
+      std::vector<interpreter::statement_t> statements;
+      std::vector<lexer::file_pos_t> positions;
+      std::vector<bool> proven;
+      std::vector<interpreter::stack_t> stacks;
+      std::vector<u32> returns;
+      u32 current = 0;
+      // input fed and not read yet, and how many whole words of it there are. the last word is not
+      // whole until whitespace follows it or the input is closed
+      std::stringstream input;
+      u64 words = 0;
+      bool partial = false, closed = false;
+      // what the program printed since the host last took it
+      std::stringstream output;
+      status_e status = ready;
+      std::string error;
+      // statements run and steps taken over the whole run
+      u64 executed = 0, steps = 0;
+   };
+
+   // lexes, loads and analyses source, failing the session when it does not
+   void load(mutref(session_t) s, ref(std::string) source);
+   // hands input to the program's reads, and ends it, after which reads get nothing
+   void feed(mutref(session_t) s, ref(std::string) text);
+   void close(mutref(session_t) s);
+   // what the program printed since last asked
+   std::string take_output(mutref(session_t) s);
+   // runs the program on this thread until it ends or fails, uses up its budget, or needs input it has not
+   // been fed. anything else the thread was running is left as it was
+   status_e step(mutref(session_t) s, ref(budget_t) budget);
+
+   // what is left of the step running on this thread. the clock is only read every few statements
+   struct slice_t {
+      u64 left, deadline;
+      u32 untilClock;
+   };
+
+   extern thread_local slice_t slice;
+
+   // true once the step's time is up
+   bool out_of_time();
+   // true when a read has no word to take yet, taking it otherwise
+   bool starved();
+
+   // policy a step runs under
+   struct policy_t : interpreter::no_policy_t {
+      static const bool suspends = true;
+      static inline bool suspend(u32 at) {
+         if (slice.left == 0 || (--slice.untilClock == 0 && out_of_time())) {
+            return true;
+         }
+         ref(interpreter::statement_t) stmt = interpreter::statements[at];
+         if (stmt[stmt.size() - 1].type == lexer::read && starved()) {
+            return true;
+         }
+         slice.left--;
+         return false;
+      }
+   };
+}
+
+#endif //STACK_SESSION_H
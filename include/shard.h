@@ -0,0 +1,33 @@
+//
+// Sharding: the loaded program run by forked processes, each over its own piece of one input file.
+//
+
+#ifndef STACK_SHARD_H
+#define STACK_SHARD_H
+
+#include <string>
+#include <ostream>
+#include <global.h>
+
+namespace shard {
+   // bytes of output a shard has room for. the room is reserved, pages are only used once written
+   const u64 out_capacity = 1ull << 30;
+
+   struct stats_t {
+      // shards run, and the bytes they read and printed
+      u32 shards;
+      u64 bytesIn, bytesOut;
+   };
+
+   extern stats_t stats;
+
+   // maps the file at path, stdin when empty, and splits it into workers pieces of about the same size,
+   // each ending at a newline. every piece is run by a forked process sharing the program it was loaded
+   // with, its reads reading only that piece and its prints going to shared memory. what each printed,
+   // followed by the error it failed with, is written to out in the order of the pieces. false when a
+   // piece failed or the file could not be split
+   bool run(ref(std::string) path, u32 workers, mutref(std::ostream) out);
+   void report(mutref(std::ostream) out);
+}
+
+#endif //STACK_SHARD_H
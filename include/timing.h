@@ -0,0 +1,69 @@
+//
+// Wall/CPU clocks and summary statistics for repeated measurements.
+//
+
+#ifndef STACK_TIMING_H
+#define STACK_TIMING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <global.h>
+
+namespace timing {
+   // wall clock in nanoseconds
+   inline u64 wall_ns() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
+
+   // process cpu time in nanoseconds
+   inline u64 cpu_ns() {
+      timespec ts { };
+      clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+      return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+   }
+
+   struct summary_t {
+      u32 n;
+      f64 min, max, mean, median, p99, stddev;
+   };
+
+   // nearest-rank percentile of sorted samples, p in [0, 1]
+   inline f64 percentile(ref(std::vector<f64>) sorted, f64 p) {
+      if (sorted.empty()) {
+         return 0;
+      }
+      size_t rank = (size_t) std::ceil(p * (f64) sorted.size());
+      return sorted[rank == 0 ? 0 : rank - 1];
+   }
+
+   inline summary_t summarize(std::vector<f64> samples) {
+      summary_t res { };
+      res.n = samples.size();
+      if (samples.empty()) {
+         return res;
+      }
+      std::sort(samples.begin(), samples.end());
+      f64 sum = 0;
+      for (f64 it : samples) {
+         sum += it;
+      }
+      res.min = samples.front();
+      res.max = samples.back();
+      res.mean = sum / (f64) samples.size();
+      res.median = samples.size() % 2 == 1 ? samples[samples.size() / 2]
+            : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+      res.p99 = percentile(samples, 0.99);
+      f64 var = 0;
+      for (f64 it : samples) {
+         var += (it - res.mean) * (it - res.mean);
+      }
+      res.stddev = samples.size() > 1 ? std::sqrt(var / (f64) (samples.size() - 1)) : 0;
+      return res;
+   }
+}
+
+#endif //STACK_TIMING_H
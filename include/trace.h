@@ -0,0 +1,55 @@
+//
+// Trace recording of hot loops, hooked into interpreter::run_with as a policy.
+//
+
+#ifndef STACK_TRACE_H
+#define STACK_TRACE_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <global.h>
+#include <interpreter.h>
+
+namespace trace {
+   // backward jumps a loop takes before its body is recorded
+   const u32 threshold = 32;
+   // longest trace that is recorded, anything longer is aborted
+   const u32 max_length = 512;
+   // aborted recordings before a loop is no longer considered
+   const u32 max_aborts = 3;
+
+   struct stats_t {
+      u64 recorded, aborted, entered, iterations, exits;
+   };
+
+   extern stats_t stats;
+   // true while the statements being executed are appended to the trace being recorded
+   extern bool recording;
+
+   // forgets every trace and counter, for a program of stmts statements
+   void reset(u32 stmts);
+   // appends a statement, and the types of the values it is about to use, to the trace being recorded
+   void record(u32 stmt);
+   // counts the back edge from -> current, records or enters the loop's trace when it is hot.
+   // current is where the interpreter carries on from when the trace exits
+   void back_edge(u32 from, mutref(u32) current, mutref(std::string) error);
+   // prints the counters and every compiled trace
+   void report(mutref(std::ostream) out);
+
+   // tracing policy for interpreter::run_with
+   struct policy_t : interpreter::no_policy_t {
+      static inline u64 begin(u32 stmt) {
+         if (recording) {
+            record(stmt);
+         }
+         return 0;
+      }
+
+      static inline void back_edge(u32 from, mutref(u32) current, mutref(std::string) error) {
+         trace::back_edge(from, current, error);
+      }
+   };
+}
+
+#endif //STACK_TRACE_H
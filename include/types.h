@@ -0,0 +1,36 @@
+//
+// Type inference over the SSA form of interpreter::statements, finding the data_type_e a stack top can
+// have at every statement.
+//
+
+#ifndef STACK_TYPES_H
+#define STACK_TYPES_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <global.h>
+#include <interpreter.h>
+
+namespace types {
+   // a bit per data_type_e a value can have, and one for the empty value push leaves behind
+   typedef u8 mask_t;
+   const mask_t blank = 1 << 5;
+   const mask_t any = 0x3f;
+
+   inline mask_t of(interpreter::data_type_e in) {
+      return 1 << in;
+   }
+
+   // possible types of every ir value
+   extern std::vector<mask_t> values;
+
+   // builds the program's SSA form and infers the types of its values
+   void infer();
+   // possible types of a node just before a statement, literals having their own
+   mask_t before(u32 stmt, ref(interpreter::node_t) in);
+   // the one type a node can have just before a statement, -1 when there is not one
+   i32 single(u32 stmt, ref(interpreter::node_t) in);
+}
+
+#endif //STACK_TYPES_H
@@ -1,25 +1,458 @@
 #include <iostream>
 #include <lexer.h>
 #include <interpreter.h>
+#include <profiler.h>
+#include <perf.h>
+#include <timing.h>
+#include <alloc.h>
+#include <jit.h>
+#include <aot.h>
+#include <trace.h>
+#include <ir.h>
+#include <depth.h>
+#include <memo.h>
+#include <parallel.h>
+#include <session.h>
+#include <io.h>
+#include <batch.h>
+#include <shard.h>
+#include <dag.h>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <cstring>
 
-int main() {
-   std::ifstream file("test.stack");
+enum phase_e {
+   read_phase,
+   lex_phase,
+   reset_phase,
+   run_phase,
+   flush_phase,
+   phase_count
+};
+
+const char* phase_names[] = { "read", "lex", "reset", "run", "flush" };
+
+struct options_t {
+   std::string path = "test.stack", jsonPath, aotPath;
+   bool profile = false, annotate = false, counters = false, jit = false, trace = false, optimise = false,
+         dumpIr = false, memo = false, regions = false;
+   u32 top = 20, repeat = 1, warmup = 0;
+   // statements and microseconds a step of a sliced run takes at most
+   u64 slice = 0, sliceMicros = 0;
+   io::backend_e io = io::off;
+   // lanes a batch run runs in lockstep, 0 not running in batches
+   u32 batch = 0;
+   // processes a sharded run splits the input between, 0 not sharding, and the file they read
+   u32 shards = 0;
+   std::string inputPath;
+};
+
+// wall and cpu samples of every phase over the measured iterations
+struct measurements_t {
+   std::vector<f64> wall[phase_count], cpu[phase_count];
+};
+
+// reads, lexes, resets and runs the file once, timing every phase. when buffered, the program's output
+// is collected and flushed to sink at the end, so the flush phase is measured on its own
+interpreter::runtime_res_t run_once(ref(options_t) opts, ptr(std::string) input, mutptr(std::ostream) sink,
+                                    mutref(measurements_t) out) {
+   u64 wall[phase_count + 1], cpu[phase_count + 1];
+   auto mark = [&](u32 phase) {
+      wall[phase] = timing::wall_ns();
+      cpu[phase] = timing::cpu_ns();
+   };
+
+   std::stringstream in, captured;
+   std::streambuf* oldIn = std::cin.rdbuf();
+   std::streambuf* oldOut = std::cout.rdbuf();
+   if (input) {
+      in.str(*input);
+      std::cin.rdbuf(in.rdbuf());
+   }
+   if (sink) {
+      std::cout.rdbuf(captured.rdbuf());
+   }
+   perf::phases.clear();
+   alloc::reset();
+
+   mark(read_phase);
+   std::ifstream file(opts.path);
    std::stringstream buf;
-   clock_t entire = clock();
    buf << file.rdbuf();
+   file.close();
+   mark(lex_phase);
    lexer::reset(buf.str());
+   perf::begin();
    auto toks = lexer::lex();
-   file.close();
+   perf::end("lex");
+   mark(reset_phase);
+   perf::begin();
+   interpreter::reset(toks);
+   if (opts.optimise) {
+      ir::optimise();
+   } else if (opts.dumpIr) {
+      ir::build();
+   }
+   std::string underflows = depth::analyse();
+   bool compiled = false;
+   if (underflows.empty() && opts.jit && jit::supported()) {
+      std::string err = jit::compile();
+      if (!err.empty()) {
+         std::cerr << err << ", falling back to the interpreter\n";
+      }
+      compiled = err.empty();
+   }
+   perf::end("reset");
+   mark(run_phase);
+   interpreter::runtime_res_t res;
+   u64 executed = 0;
+   perf::begin();
+   if (!underflows.empty()) {
+      res = { interpreter::data_t { }, underflows };
+   } else if (opts.profile) {
+      profiler::reset(interpreter::statements.size());
+      res = interpreter::run_with<profiler::policy_t>();
+      for (ref(profiler::stmt_stats_t) it : profiler::stats) {
+         executed += it.count;
+      }
+   } else if (compiled) {
+      res = jit::run();
+   } else if (opts.trace) {
+      trace::reset(interpreter::statements.size());
+      res = interpreter::run_with<trace::policy_t>();
+   } else if (opts.memo) {
+      memo::reset();
+      res = interpreter::run_with<memo::policy_t>();
+   } else if (opts.regions) {
+      dag::analyse();
+      res = interpreter::run_with<dag::policy_t>();
+   } else if (opts.counters) {
+      perf::count_policy_t::executed = 0;
+      res = interpreter::run_with<perf::count_policy_t>();
+      executed = perf::count_policy_t::executed;
+   } else {
+      res = interpreter::run();
+   }
+   perf::end("run", executed);
+   mark(flush_phase);
+   if (sink) {
+      std::cout.rdbuf(oldOut);
+      *sink << captured.rdbuf();
+      sink->flush();
+   } else {
+      std::cout.flush();
+   }
+   mark(phase_count);
+   std::cin.rdbuf(oldIn);
+
+   for (u32 i = 0; i < phase_count; i++) {
+      out.wall[i].push_back((f64) (wall[i + 1] - wall[i]));
+      out.cpu[i].push_back((f64) (cpu[i + 1] - cpu[i]));
+   }
+   return res;
+}
+
+void json_summary(mutref(std::ostream) out, ref(timing::summary_t) s) {
+   out << "{\"min\": " << s.min << ", \"median\": " << s.median << ", \"p99\": " << s.p99
+       << ", \"mean\": " << s.mean << ", \"max\": " << s.max << "}";
+}
+
+void write_json(mutref(std::ostream) out, ref(options_t) opts, ref(measurements_t) m) {
+   out << "{\n  \"file\": \"" << replace_all(opts.path, "\"", "\\\"") << "\",\n  \"unit\": \"ns\",\n"
+       << "  \"repeat\": " << opts.repeat << ",\n  \"warmup\": " << opts.warmup << ",\n  \"phases\": {\n";
+   for (u32 i = 0; i < phase_count; i++) {
+      out << "    \"" << phase_names[i] << "\": {\"wall\": ";
+      json_summary(out, timing::summarize(m.wall[i]));
+      out << ", \"cpu\": ";
+      json_summary(out, timing::summarize(m.cpu[i]));
+      out << (i + 1 == phase_count ? "}\n" : "},\n");
+   }
+   out << "  }\n}\n";
+}
+
+void write_table(mutref(std::ostream) out, ref(measurements_t) m) {
+   out << std::setw(8) << "phase" << std::setw(14) << "wall min" << std::setw(14) << "wall median"
+       << std::setw(14) << "wall p99" << std::setw(14) << "cpu min" << std::setw(14) << "cpu median"
+       << std::setw(14) << "cpu p99" << "  (us)\n";
+   std::ios::fmtflags flags = out.flags();
+   out << std::fixed << std::setprecision(3);
+   for (u32 i = 0; i < phase_count; i++) {
+      timing::summary_t wall = timing::summarize(m.wall[i]), cpu = timing::summarize(m.cpu[i]);
+      out << std::setw(8) << phase_names[i] << std::setw(14) << wall.min / 1e3 << std::setw(14) << wall.median / 1e3
+          << std::setw(14) << wall.p99 / 1e3 << std::setw(14) << cpu.min / 1e3 << std::setw(14) << cpu.median / 1e3
+          << std::setw(14) << cpu.p99 / 1e3 << '\n';
+   }
+   out.flags(flags);
+}
+
+// runs the file as a session a slice at a time, feeding it stdin a line at a time only once it waits for it
+int run_sliced(ref(options_t) opts) {
+   std::ifstream file(opts.path);
+   std::stringstream buf;
+   buf << file.rdbuf();
+   session::session_t s;
+   session::load(s, buf.str());
+   session::budget_t budget { opts.slice, opts.sliceMicros };
+   u64 waits = 0;
+   while (true) {
+      session::status_e status = session::step(s, budget);
+      std::cout << session::take_output(s);
+      if (status == session::waiting) {
+         waits++;
+         std::string line;
+         if (std::getline(std::cin, line)) {
+            session::feed(s, line + "\n");
+         } else {
+            session::close(s);
+         }
+      } else if (status != session::ready) {
+         break;
+      }
+   }
+   std::cout.flush();
+   std::cerr << "session: " << s.steps << " steps, " << s.executed << " statements, " << waits
+             << " waits for input\n";
+   if (s.status == session::failed) {
+      std::cout << s.error;
+      return 1;
+   }
+   std::cout << '\n' << "completed successfully\n";
+   return 0;
+}
+
+// runs the file once for every line of stdin, as the input its reads see, batch lines at a time in lockstep
+int run_batch(ref(options_t) opts) {
+   std::ifstream file(opts.path);
+   std::stringstream buf;
+   buf << file.rdbuf();
+   lexer::reset(buf.str());
+   auto toks = lexer::lex();
+   if (!lexer::error.empty()) {
+      return 1;
+   }
+   interpreter::reset(toks);
+   if (opts.optimise) {
+      ir::optimise();
+   }
+   std::string err = depth::analyse();
+   if (err.empty()) {
+      err = batch::supported();
+   }
+   if (!err.empty()) {
+      std::cout << err;
+      return 1;
+   }
+   std::vector<std::string> inputs;
+   std::string line;
+   while (std::getline(std::cin, line)) {
+      inputs.push_back(line);
+   }
+   bool failed = false;
+   for (ref(batch::result_t) it : batch::run(inputs, opts.batch)) {
+      std::cout << it.output << it.error;
+      failed |= !it.error.empty();
+   }
+   std::cout.flush();
+   batch::report(std::cerr);
+   if (failed) {
+      return 1;
+   }
+   std::cout << '\n' << "completed successfully\n";
+   return 0;
+}
+
+// compiles the file to C++ instead of running it
+int compile_aot(ref(options_t) opts) {
+   std::ifstream file(opts.path);
+   std::stringstream buf;
+   buf << file.rdbuf();
+   lexer::reset(buf.str());
+   auto toks = lexer::lex();
+   if (!lexer::error.empty()) {
+      return 1;
+   }
    interpreter::reset(toks);
-   clock_t runtime = clock();
-   interpreter::runtime_res_t res = interpreter::run();
-   clock_t now = clock();
+   if (opts.optimise) {
+      ir::optimise();
+   }
+   std::string underflows = depth::analyse();
+   if (!underflows.empty()) {
+      std::cout << underflows;
+      return 1;
+   }
+   std::ofstream out(opts.aotPath);
+   std::string err = aot::emit(out, buf.str(), opts.path, opts.optimise);
+   if (!err.empty()) {
+      std::cout << err;
+      return 1;
+   }
+   return 0;
+}
+
+// runs the file the way the options ask, as many times as they ask
+int run_file(ref(options_t) opts) {
+   if (opts.jit && !jit::supported()) {
+      std::cerr << "jit: not supported on this platform, using the interpreter\n";
+   }
+   if (opts.counters && !perf::open()) {
+      std::cerr << "perf: no hardware counters available, reporting without them\n";
+   }
+
+   // when running more than once, stdin is read up front so every iteration sees the same input, and
+   // the program's output is only written to stdout by the last iteration
+   u32 iterations = opts.warmup + opts.repeat;
+   std::string input;
+   if (iterations > 1) {
+      std::stringstream ss;
+      ss << std::cin.rdbuf();
+      input = ss.str();
+   }
+   std::ofstream devNull("/dev/null");
+
+   measurements_t warm, measured;
+   interpreter::runtime_res_t res;
+   for (u32 i = 0; i < iterations; i++) {
+      bool last = i + 1 == iterations;
+      std::ostream* sink = iterations == 1 ? nullptr : last ? &std::cout : &devNull;
+      res = run_once(opts, iterations == 1 ? nullptr : &input, sink, i < opts.warmup ? warm : measured);
+      if (!res.second.empty()) {
+         break;
+      }
+   }
+
+   if (opts.profile) {
+      profiler::report(std::cerr, opts.top, opts.annotate);
+   }
+   if (opts.dumpIr) {
+      ir::dump(std::cerr);
+   }
+   if (opts.trace) {
+      trace::report(std::cerr);
+   }
+   if (opts.memo) {
+      memo::report(std::cerr);
+   }
+   if (opts.regions) {
+      dag::report(std::cerr);
+   }
+   if (opts.counters) {
+      perf::report(std::cerr);
+      perf::close();
+   }
    if (!res.second.empty()) {
       std::cout << res.second;
       return 1;
    }
-   std::cout << '\n' << "completed successfully (lex+runtime: " << now - entire << ", runtime: " << now - runtime << ")";
+   std::cout << '\n' << "completed successfully\n";
+   if (opts.jsonPath == "-") {
+      write_json(std::cout, opts, measured);
+      return 0;
+   }
+   write_table(std::cout, measured);
+   if (!opts.jsonPath.empty()) {
+      std::ofstream out(opts.jsonPath);
+      write_json(out, opts, measured);
+   }
+   return 0;
+}
+
+// runs the file in forked processes, each reading its own newline-aligned piece of the input file
+int run_sharded(ref(options_t) opts) {
+   std::ifstream file(opts.path);
+   std::stringstream buf;
+   buf << file.rdbuf();
+   lexer::reset(buf.str());
+   auto toks = lexer::lex();
+   if (!lexer::error.empty()) {
+      return 1;
+   }
+   interpreter::reset(toks);
+   if (opts.optimise) {
+      ir::optimise();
+   }
+   std::string err = depth::analyse();
+   if (!err.empty()) {
+      std::cout << err;
+      return 1;
+   }
+   bool ok = shard::run(opts.inputPath, opts.shards, std::cout);
+   std::cout.flush();
+   shard::report(std::cerr);
+   if (!ok) {
+      return 1;
+   }
+   std::cout << '\n' << "completed successfully\n";
    return 0;
 }
+
+int main(int argc, char** argv) {
+   options_t opts;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "--profile")) {
+         opts.profile = true;
+      } else if (!strcmp(argv[i], "--annotate")) {
+         opts.profile = opts.annotate = true;
+      } else if (!strcmp(argv[i], "--alloc-stats")) {
+         alloc::reporting = true;
+      } else if (!strcmp(argv[i], "--aot") && i + 1 < argc) {
+         opts.aotPath = argv[++i];
+      } else if (!strcmp(argv[i], "--jit")) {
+         opts.jit = true;
+      } else if (!strcmp(argv[i], "-O") || !strcmp(argv[i], "--optimise")) {
+         opts.optimise = true;
+      } else if (!strcmp(argv[i], "--inline") && i + 1 < argc) {
+         ir::inline_limit = std::strtoul(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--dump-ir")) {
+         opts.dumpIr = true;
+      } else if (!strcmp(argv[i], "--trace")) {
+         opts.trace = true;
+      } else if (!strcmp(argv[i], "--memo")) {
+         opts.memo = true;
+      } else if (!strcmp(argv[i], "--regions")) {
+         opts.regions = true;
+      } else if (!strcmp(argv[i], "--perf")) {
+         opts.counters = true;
+      } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+         parallel::threads = std::strtoul(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--slice") && i + 1 < argc) {
+         opts.slice = std::strtoull(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--slice-us") && i + 1 < argc) {
+         opts.sliceMicros = std::strtoull(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--batch") && i + 1 < argc) {
+         opts.batch = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+      } else if (!strcmp(argv[i], "--shards") && i + 1 < argc) {
+         opts.shards = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+      } else if (!strcmp(argv[i], "--input") && i + 1 < argc) {
+         opts.inputPath = argv[++i];
+      } else if (!strcmp(argv[i], "--async-io")) {
+         opts.io = io::uring;
+      } else if (!strcmp(argv[i], "--blocking-io")) {
+         opts.io = io::blocking;
+      } else if (!strcmp(argv[i], "--top") && i + 1 < argc) {
+         opts.top = std::strtoul(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+         opts.repeat = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+      } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+         opts.warmup = std::strtoul(argv[++i], nullptr, 10);
+      } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+         opts.jsonPath = argv[++i];
+      } else {
+         opts.path = argv[i];
+      }
+   }
+
+   if (!opts.aotPath.empty()) {
+      return compile_aot(opts);
+   }
+   if (opts.io != io::off && io::start(opts.io) != opts.io) {
+      std::cerr << "io: no io_uring available, using " << io::to_string(io::backend) << "\n";
+   }
+   int code = opts.shards != 0 ? run_sharded(opts) : opts.batch != 0 ? run_batch(opts)
+         : opts.slice != 0 || opts.sliceMicros != 0 ? run_sliced(opts) : run_file(opts);
+   if (io::backend != io::off) {
+      io::stop();
+      io::report(std::cerr);
+   }
+   return code;
+}
@@ -0,0 +1,65 @@
+//
+// Allocation accounting for the interpreter, every value allocation goes through alloc::make.
+//
+
+#include <alloc.h>
+#include <iomanip>
+#include <sys/resource.h>
+
+thread_local alloc::site_stats_t alloc::sites[site_count];
+thread_local u64 alloc::live = 0, alloc::peak = 0;
+bool alloc::reporting = false;
+
+std::string alloc::to_string(site_e in) {
+   return (std::string[]) {
+      "literal", "arithmetic", "conversion", "comparison", "read", "array-growth", "program"
+   }[in];
+}
+
+void alloc::reset() {
+   for (site_stats_t& it : sites) {
+      it = site_stats_t { };
+   }
+   live = peak = 0;
+}
+
+void alloc::absorb(mutptr(site_stats_t) from, mutref(u64) fromLive) {
+   for (u32 i = 0; i < site_count; i++) {
+      sites[i].count += from[i].count;
+      sites[i].bytes += from[i].bytes;
+      sites[i].freed += from[i].freed;
+      from[i] = site_stats_t { };
+   }
+   live += fromLive;
+   fromLive = 0;
+   if (live > peak) {
+      peak = live;
+   }
+}
+
+u64 alloc::peak_rss() {
+   rusage usage { };
+   if (getrusage(RUSAGE_SELF, &usage) != 0) {
+      return 0;
+   }
+#ifdef __APPLE__
+   return usage.ru_maxrss;
+#else
+   return (u64) usage.ru_maxrss * 1024;
+#endif
+}
+
+void alloc::report(mutref(std::ostream) out) {
+   u64 count = 0, bytes = 0;
+   out << std::setw(14) << "site" << std::setw(14) << "allocations" << std::setw(14) << "bytes"
+       << std::setw(14) << "freed" << '\n';
+   for (u32 i = 0; i < site_count; i++) {
+      ref(site_stats_t) it = sites[i];
+      out << std::setw(14) << to_string((site_e) i) << std::setw(14) << it.count << std::setw(14) << it.bytes
+          << std::setw(14) << it.freed << '\n';
+      count += it.count;
+      bytes += it.bytes;
+   }
+   out << std::setw(14) << "total" << std::setw(14) << count << std::setw(14) << bytes << '\n';
+   out << "live bytes: " << live << ", peak live bytes: " << peak << ", peak rss: " << peak_rss() << " bytes\n";
+}
@@ -0,0 +1,679 @@
+//
+// Ahead-of-time compilation of a reset program to a standalone C++ translation unit.
+//
+// labels, jumps and beginf become gotos, endf a switch over the statements that can be returned to.
+// stacks whose values are provably always the same numeric type become std::vector locals of that
+// type, and the statements touching only them and literals become plain C++, as do operations on
+// runtime stacks whose tops types::infer proves are numbers of one type there. a typed stack that
+// depth::analyse finds at one known depth wherever it is used gets a local per slot instead of a
+// vector, so its pushes and pops vanish and the C++ compiler can keep the slots in registers. everything
+// else calls the interpreter's exec_* helpers on the statements the generated code rebuilds at startup.
+//
+
+#include <aot.h>
+#include <types.h>
+#include <depth.h>
+#include <ir.h>
+#include <set>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+
+using namespace interpreter;
+
+// what is known about the values written to a stack over the whole program
+enum kind_e {
+   unwritten,
+   chr_kind,
+   int_kind,
+   fp_kind,
+   dynamic
+};
+
+static kind_e kinds[26];
+static bool typed[26];
+// deepest slot of every typed stack kept in a local per slot, 0 for the ones kept in vectors
+static u32 slots[26];
+// does the statement being emitted check the stacks it uses for emptiness, false once depth::analyse
+// proved it need not
+static bool checking;
+// the statement being emitted
+static u32 emitting;
+
+static kind_e join(kind_e a, kind_e b) {
+   if (a == unwritten) {
+      return b;
+   }
+   if (b == unwritten || a == b) {
+      return a;
+   }
+   return dynamic;
+}
+
+static bool numeric(kind_e in) {
+   return in == chr_kind || in == int_kind || in == fp_kind;
+}
+
+static bool is_literal(ref(node_t) in) {
+   return in.type == lexer::integer || in.type == lexer::chr || in.type == lexer::fp || in.type == lexer::str;
+}
+
+static u32 stack_of(ref(node_t) in) {
+   return any_cast<u32>(in.data);
+}
+
+static kind_e kind_of(ref(node_t) in) {
+   switch (in.type) {
+      case lexer::chr:
+         return chr_kind;
+      case lexer::integer:
+         return int_kind;
+      case lexer::fp:
+         return fp_kind;
+      case lexer::stack:
+         return kinds[stack_of(in)];
+      default:
+         return dynamic;
+   }
+}
+
+static bool is_op(lexer::tok_type_e op) {
+   switch (op) {
+      case lexer::add:
+      case lexer::sub:
+      case lexer::mul:
+      case lexer::div:
+      case lexer::idiv:
+      case lexer::mod:
+      case lexer::eq:
+      case lexer::neq:
+      case lexer::gt:
+      case lexer::lt:
+      case lexer::gte:
+      case lexer::lte:
+      case lexer::and_:
+      case lexer::or_:
+      case lexer::xor_:
+         return true;
+      default:
+         return false;
+   }
+}
+
+// kinds of the two operands handle_op reads, the first negated when the statement starts with '-'
+static std::pair<kind_e, kind_e> operand_kinds(ref(statement_t) stmt, kind_e (* kind)(ref(node_t)) = kind_of) {
+   if (stmt[0].type == lexer::sub) {
+      kind_e k = kind(stmt[1]);
+      return { k == int_kind || k == fp_kind ? k : dynamic, k };
+   }
+   return { kind(stmt[0]), kind(stmt[1]) };
+}
+
+// kind of the value an operation writes, when it succeeds
+static kind_e result_kind(lexer::tok_type_e op, kind_e a, kind_e b) {
+   switch (op) {
+      case lexer::eq:
+      case lexer::neq:
+      case lexer::and_:
+      case lexer::or_:
+      case lexer::xor_:
+         return chr_kind;
+      case lexer::gt:
+      case lexer::lt:
+      case lexer::gte:
+      case lexer::lte:
+         // comp_op leaves an empty data_t behind for these
+         return dynamic;
+      case lexer::idiv:
+         return numeric(a) && numeric(b) ? int_kind : dynamic;
+      default:
+         return numeric(a) && numeric(b) ? std::max(a, b) : dynamic;
+   }
+}
+
+static kind_e cast_kind(ref(statement_t) stmt) {
+   switch (any_cast<data_type_e>(stmt[2].data)) {
+      case data_type_e::chr:
+         return chr_kind;
+      case data_type_e::integer:
+         return int_kind;
+      case data_type_e::fp:
+         return fp_kind;
+      default:
+         return dynamic;
+   }
+}
+
+// flow-insensitive: joins the kind of every value ever written to each stack until nothing changes
+static void infer_kinds() {
+   std::fill(kinds, kinds + 26, unwritten);
+   bool changed = true;
+   while (changed) {
+      changed = false;
+      auto write = [&](ref(node_t) dest, kind_e kind) {
+         if (dest.type != lexer::stack) {
+            return;
+         }
+         kind_e joined = join(kinds[stack_of(dest)], kind);
+         changed |= joined != kinds[stack_of(dest)];
+         kinds[stack_of(dest)] = joined;
+      };
+      for (ref(statement_t) stmt : statements) {
+         lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+         if (is_op(op)) {
+            std::pair<kind_e, kind_e> in = operand_kinds(stmt);
+            write(stmt[stmt.size() - 2], result_kind(op, in.first, in.second));
+         } else if (op == lexer::stack) {
+            write(stmt[stmt.size() - 1], kind_of(stmt[0]));
+         } else if (op == lexer::cast) {
+            write(stmt[1], cast_kind(stmt));
+         } else if (op == lexer::read || op == lexer::receive || op == lexer::coroutine) {
+            write(stmt[0], dynamic);
+         } else if (op == lexer::map || op == lexer::reduce || op == lexer::resume || op == lexer::done) {
+            write(stmt[1], dynamic);
+         }
+      }
+   }
+}
+
+// every stack a statement names
+static std::vector<u32> stacks_in(ref(statement_t) stmt) {
+   std::vector<u32> res;
+   for (ref(node_t) node : stmt) {
+      if (node.type == lexer::stack || node.type == lexer::push || node.type == lexer::pop) {
+         res.push_back(stack_of(node));
+      }
+   }
+   return res;
+}
+
+// can an operation on operands of these kinds be plain C++ arithmetic on them
+static bool numeric_op(ref(statement_t) stmt, std::pair<kind_e, kind_e> in) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (stmt.size() < 3 || (stmt[0].type == lexer::sub && stmt.size() < 4)) {
+      return false;
+   }
+   ref(node_t) dest = stmt[stmt.size() - 2];
+   if (!numeric(in.first) || !numeric(in.second) || dest.type != lexer::stack) {
+      return false;
+   }
+   if ((op == lexer::eq || op == lexer::neq) && in.first != in.second) {
+      return false;
+   }
+   return result_kind(op, in.first, in.second) != dynamic;
+}
+
+// can the statement's stack operands be either all typed locals or all runtime stacks
+static bool native(ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   std::vector<u32> used = stacks_in(stmt);
+   u32 count = 0;
+   for (u32 it : used) {
+      count += typed[it];
+   }
+   if (count == 0 || op == lexer::push || op == lexer::pop || op == lexer::jump) {
+      return true;
+   }
+   if (count != used.size()) {
+      return false;
+   }
+   if (is_op(op)) {
+      return numeric_op(stmt, operand_kinds(stmt));
+   }
+   switch (op) {
+      case lexer::stack:
+         return stmt.size() == 2 && numeric(kind_of(stmt[0]));
+      case lexer::cast:
+         return stmt.size() == 3 && numeric(kind_of(stmt[0])) && numeric(cast_kind(stmt));
+      case lexer::print:
+         for (u32 i = 0; i + 1 < stmt.size(); i++) {
+            if (stmt[i].type != lexer::stack && !is_literal(stmt[i])) {
+               return false;
+            }
+         }
+         return true;
+      default:
+         return false;
+   }
+}
+
+// picks the typed stacks, dropping the ones used by a statement that cannot be emitted with them
+static void choose_typed() {
+   // mapped and spawned functions and coroutines run in the interpreter on copies of the runtime stacks,
+   // which have to hold everything, and so do the values passed between them
+   bool mapping = false;
+   for (ref(statement_t) stmt : statements) {
+      lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      mapping |= op == lexer::map || op == lexer::spawn || op == lexer::send || op == lexer::receive
+            || op == lexer::coroutine || op == lexer::resume || op == lexer::yield || op == lexer::done;
+   }
+   for (u32 i = 0; i < 26; i++) {
+      typed[i] = !mapping && numeric(kinds[i]);
+   }
+   bool changed = true;
+   while (changed) {
+      changed = false;
+      for (ref(statement_t) stmt : statements) {
+         if (native(stmt)) {
+            continue;
+         }
+         for (u32 it : stacks_in(stmt)) {
+            changed |= typed[it];
+            typed[it] = false;
+         }
+      }
+   }
+}
+
+// gives a local per slot to the typed stacks that are at one known depth in every statement using them
+static void choose_slots() {
+   for (u32 s = 0; s < 26; s++) {
+      slots[s] = 0;
+      if (!typed[s] || depth::reached.size() != statements.size()) {
+         continue;
+      }
+      bool known = true;
+      u32 deepest = 0;
+      for (u32 i = 0; known && i < statements.size(); i++) {
+         std::vector<u32> used = stacks_in(statements[i]);
+         if (std::find(used.begin(), used.end(), s) == used.end()) {
+            continue;
+         }
+         ref(depth::range_t) range = depth::before[i][s];
+         known = depth::reached[i] && range.lo == range.hi;
+         lexer::tok_type_e op = statements[i][statements[i].size() - 1].type;
+         deepest = std::max(deepest, range.hi + (op == lexer::push));
+      }
+      slots[s] = known ? deepest : 0;
+   }
+}
+
+static std::string escape(ref(std::string) in) {
+   std::stringstream ss;
+   ss << '"';
+   for (char c : in) {
+      switch (c) {
+         case '"':
+            ss << "\\\"";
+            break;
+         case '\\':
+            ss << "\\\\";
+            break;
+         case '\n':
+            ss << "\\n\"\n      \"";
+            break;
+         case '\t':
+            ss << "\\t";
+            break;
+         default:
+            if (std::isprint((unsigned char) c)) {
+               ss << c;
+            } else {
+               ss << '\\' << std::oct << std::setw(3) << std::setfill('0') << (u32) (unsigned char) c << std::dec;
+            }
+      }
+   }
+   ss << '"';
+   return ss.str();
+}
+
+static const char* type_name(kind_e in) {
+   switch (in) {
+      case chr_kind:
+         return "char";
+      case int_kind:
+         return "i64";
+      default:
+         return "f64";
+   }
+}
+
+static std::string literal(ref(node_t) in) {
+   std::stringstream ss;
+   switch (in.type) {
+      case lexer::integer:
+         ss << "(i64) " << any_cast<i64>(in.data) << "ll";
+         break;
+      case lexer::chr:
+         ss << "(char) " << (i32) any_cast<char>(in.data);
+         break;
+      default: {
+         f64 val = any_cast<f64>(in.data);
+         if (std::isfinite(val)) {
+            ss << "(f64) " << std::hexfloat << val;
+         } else {
+            ss << "(f64) HUGE_VAL";
+         }
+      }
+   }
+   return ss.str();
+}
+
+// the kind of a node at the statement being emitted: a typed local's, or the one types::infer proved a
+// runtime stack's top has there
+static kind_e node_kind(ref(node_t) in) {
+   if (in.type != lexer::stack || typed[stack_of(in)]) {
+      return kind_of(in);
+   }
+   switch (types::single(emitting, in)) {
+      case data_type_e::chr:
+         return chr_kind;
+      case data_type_e::integer:
+         return int_kind;
+      case data_type_e::fp:
+         return fp_kind;
+      default:
+         return dynamic;
+   }
+}
+
+// a typed local, or the runtime's stack
+static std::string stack_name(u32 idx) {
+   return typed[idx] ? "t_" + std::string(1, (char) ('a' + idx)) : "stacks[" + std::to_string(idx) + "]";
+}
+
+// the top of a typed stack at the statement being emitted
+static std::string top(u32 idx) {
+   if (slots[idx]) {
+      return stack_name(idx) + std::to_string(depth::before[emitting][idx].hi);
+   }
+   return stack_name(idx) + ".back()";
+}
+
+static std::string value(ref(node_t) in) {
+   if (in.type != lexer::stack) {
+      return literal(in);
+   }
+   if (typed[stack_of(in)]) {
+      return top(stack_of(in));
+   }
+   return "any_cast<" + std::string(type_name(node_kind(in))) + ">(" + stack_name(stack_of(in)) + ".top().data)";
+}
+
+static std::string convert(ref(std::string) expr, kind_e from, kind_e to) {
+   if (from == to) {
+      return expr;
+   }
+   return "(" + std::string(type_name(to)) + ") (" + expr + ")";
+}
+
+static std::string label(u32 stmt) {
+   return stmt >= statements.size() ? "end" : "L" + std::to_string(stmt);
+}
+
+static void fail_if(mutref(std::ostream) out, ref(std::string) cond, ref(std::string) msg) {
+   if (!checking) {
+      return;
+   }
+   out << "      if (" << cond << ") { error = \"" << msg << "\"; goto fail; }\n";
+}
+
+// the interpreter's error when reading an empty stack
+static void check_read(mutref(std::ostream) out, ref(node_t) in) {
+   if (in.type == lexer::stack && !slots[stack_of(in)]) {
+      fail_if(out, stack_name(stack_of(in)) + ".empty()", "interpreter::node_to_data: stack is empty");
+   }
+}
+
+static void check_write(mutref(std::ostream) out, u32 idx, ref(std::string) msg) {
+   if (slots[idx]) {
+      return;
+   }
+   fail_if(out, stack_name(idx) + ".empty()", msg);
+}
+
+static void emit_runtime(mutref(std::ostream) out, ref(std::string) call, u32 i) {
+   out << "      res = " << call << (checking ? "" : "<false>") << "(s[" << i << "]);\n";
+   out << "      if (!res.second.empty()) { error = res.second; goto fail; }\n";
+}
+
+// an operation on numbers, kept in typed locals or in runtime stacks whose types are proven
+static void emit_op(mutref(std::ostream) out, ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   std::pair<kind_e, kind_e> in = operand_kinds(stmt, node_kind);
+   bool negated = stmt[0].type == lexer::sub;
+   ref(node_t) first = negated ? stmt[1] : stmt[0];
+   check_read(out, first);
+   check_read(out, stmt[1]);
+   std::string a = negated ? "-" + value(first) : value(first), b = value(stmt[1]);
+   kind_e res = result_kind(op, in.first, in.second);
+   std::string expr;
+   switch (op) {
+      case lexer::eq:
+         expr = "(char) (" + a + " == " + b + ")";
+         break;
+      case lexer::neq:
+         expr = "(char) (" + a + " != " + b + ")";
+         break;
+      case lexer::and_:
+         expr = "(char) ((" + a + ") != 0 && (" + b + ") != 0)";
+         break;
+      case lexer::or_:
+         expr = "(char) ((" + a + ") != 0 || (" + b + ") != 0)";
+         break;
+      case lexer::xor_:
+         expr = "(char) (((" + a + ") != 0) != ((" + b + ") != 0))";
+         break;
+      case lexer::mod:
+         if (res == fp_kind) {
+            expr = "fmod(" + convert(a, in.first, res) + ", " + convert(b, in.second, res) + ")";
+            break;
+         }
+      default: {
+         const char* sym = op == lexer::add ? " + " : op == lexer::sub ? " - " : op == lexer::mul ? " * "
+               : op == lexer::mod ? " % " : " / ";
+         expr = "(" + std::string(type_name(res)) + ") (" + convert(a, in.first, res) + sym
+                + convert(b, in.second, res) + ")";
+      }
+   }
+   u32 dest = stack_of(stmt[stmt.size() - 2]);
+   out << "      " << type_name(res) << " r = " << expr << ";\n";
+   check_write(out, dest, "interpreter::run@basic_op: specified stack is empty");
+   if (typed[dest]) {
+      out << "      " << top(dest) << " = r;\n";
+      return;
+   }
+   const char* type = res == chr_kind ? "chr" : res == int_kind ? "integer" : "fp";
+   const char* site = op == lexer::add || op == lexer::sub || op == lexer::mul || op == lexer::div
+         || op == lexer::idiv || op == lexer::mod ? "arithmetic" : "comparison";
+   out << "      " << stack_name(dest) << ".top() = data_t { data_type_e::" << type << ", alloc::make<"
+       << type_name(res) << ">(alloc::" << site << ", r) };\n";
+}
+
+static void emit_statement(mutref(std::ostream) out, u32 i) {
+   ref(statement_t) stmt = statements[i];
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   checking = i >= proven.size() || !proven[i];
+   emitting = i;
+   bool local = false;
+   for (u32 it : stacks_in(stmt)) {
+      local |= typed[it];
+   }
+   switch (op) {
+      case lexer::push:
+      case lexer::pop: {
+         u32 idx = stack_of(stmt[0]);
+         if (slots[idx]) {
+            // the slot above is only cleared, like a freshly pushed value
+            if (op == lexer::push) {
+               out << "      " << stack_name(idx) << depth::before[i][idx].hi + 1 << " = 0;\n";
+            }
+            break;
+         }
+         if (op == lexer::pop) {
+            fail_if(out, stack_name(idx) + ".empty()", "interpreter::run@pop: stack trying to be popped is empty!");
+         }
+         if (typed[idx]) {
+            out << "      " << stack_name(idx) << (op == lexer::push ? ".push_back(0);\n" : ".pop_back();\n");
+         } else {
+            out << "      stacks[" << idx << "]." << (op == lexer::push ? "push(data_t { });\n" : "pop();\n");
+         }
+         break;
+      }
+      case lexer::beginf:
+         out << "      goto " << label(any_cast<u32>(stmt[0].data)) << ";\n";
+         break;
+      case lexer::endf: {
+         out << "      res = pop_return" << (checking ? "" : "<false>") << "(ret);\n";
+         out << "      if (!res.second.empty()) { error = res.second; goto fail; }\n";
+         out << "      switch (ret) {\n";
+         for (u32 j = 0; j < statements.size(); j++) {
+            ref(statement_t) it = statements[j];
+            if (it[it.size() - 1].type == lexer::jump) {
+               out << "         case " << j + 1 << ": goto " << label(j + 1) << ";\n";
+            }
+         }
+         out << "      }\n";
+         out << "      error = \"aot: returned to a statement no jump comes from\";\n      goto fail;\n";
+         break;
+      }
+      case lexer::jump: {
+         bool negated = stmt[0].type == lexer::not_;
+         ref(node_t) cond = stmt[negated];
+         std::string target = label(any_cast<u32>(stmt[stmt.size() - 1].data));
+         if (cond.type == lexer::stack && numeric(node_kind(cond))) {
+            check_read(out, cond);
+            out << "      if ((" << value(cond) << " != 0) " << (negated ? "== false" : "== true") << ") {\n";
+         } else if (!negated && cond.type != lexer::stack && cond.type != lexer::str && is_literal(cond)) {
+            out << "      if (" << value(cond) << " != 0) {\n";
+         } else {
+            emit_runtime(out, "exec_cond", i);
+            out << "      if (is_true(res.first)) {\n";
+         }
+         if (!tail_call(i)) {
+            out << "         push_return(" << i + 1 << ");\n";
+         }
+         out << "         goto " << target << ";\n      }\n";
+         break;
+      }
+      case lexer::print:
+         if (!local) {
+            emit_runtime(out, "exec_print", i);
+            break;
+         }
+         for (u32 j = 0; j + 1 < stmt.size(); j++) {
+            if (stmt[j].type == lexer::str) {
+               out << "      std::cout << " << escape(any_cast<std::string>(stmt[j].data)) << ";\n";
+            } else {
+               check_read(out, stmt[j]);
+               out << "      std::cout << std::to_string(" << value(stmt[j]) << ");\n";
+            }
+         }
+         break;
+      case lexer::stack: {
+         if (!local) {
+            emit_runtime(out, "exec_set", i);
+            break;
+         }
+         u32 dest = stack_of(stmt[1]);
+         check_read(out, stmt[0]);
+         check_write(out, dest, "interpreter::run@stack: stack trying to be set is empty!");
+         out << "      " << top(dest) << " = " << value(stmt[0]) << ";\n";
+         break;
+      }
+      case lexer::cast: {
+         if (!local) {
+            emit_runtime(out, "exec_cast", i);
+            break;
+         }
+         u32 dest = stack_of(stmt[1]);
+         check_read(out, stmt[0]);
+         check_write(out, dest, "interpreter::run@stack: stack trying to be set is empty!");
+         out << "      " << top(dest) << " = "
+             << convert(value(stmt[0]), kind_of(stmt[0]), kinds[dest]) << ";\n";
+         break;
+      }
+      case lexer::read:
+         emit_runtime(out, "exec_read", i);
+         break;
+      case lexer::map:
+      case lexer::reduce:
+         out << "      res = " << (op == lexer::map ? "parallel::map" : "reduce::exec") << "(s[" << i << "]);\n";
+         out << "      if (!res.second.empty()) { error = res.second; goto fail; }\n";
+         break;
+      case lexer::send:
+      case lexer::receive:
+      case lexer::spawn:
+         out << "      res = channel::" << lexer::to_string(op) << "(s[" << i << "]);\n";
+         out << "      if (!res.second.empty()) { error = res.second; goto fail; }\n";
+         break;
+      case lexer::coroutine:
+      case lexer::resume:
+      case lexer::yield:
+      case lexer::done:
+         out << "      res = coroutine::" << (op == lexer::coroutine ? "create" : lexer::to_string(op)) << "(s[" << i
+             << "]);\n";
+         out << "      if (!res.second.empty()) { error = res.second; goto fail; }\n";
+         break;
+      default:
+         if (!is_op(op)) {
+            break;
+         }
+         if (local || numeric_op(stmt, operand_kinds(stmt, node_kind))) {
+            emit_op(out, stmt);
+         } else {
+            emit_runtime(out, "exec_op", i);
+         }
+   }
+}
+
+std::string aot::emit(mutref(std::ostream) out, ref(std::string) source, ref(std::string) name, bool optimised) {
+   infer_kinds();
+   choose_typed();
+   choose_slots();
+   types::infer();
+
+   // statements something jumps or returns to
+   std::set<u32> targets;
+   for (u32 i = 0; i < statements.size(); i++) {
+      ref(statement_t) stmt = statements[i];
+      lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      if (op == lexer::jump) {
+         targets.insert(any_cast<u32>(stmt[stmt.size() - 1].data));
+         targets.insert(i + 1);
+      } else if (op == lexer::beginf) {
+         targets.insert(any_cast<u32>(stmt[0].data));
+      }
+   }
+
+   out << "// generated from " << name << " by stack --aot, link against stack_core\n"
+       << "#include <interpreter.h>\n#include <lexer.h>\n#include <ir.h>\n#include <alloc.h>\n#include <parallel.h>\n#include <reduce.h>\n#include <channel.h>\n#include <coroutine.h>\n#include <iostream>\n#include <vector>\n#include <cmath>\n\n"
+       << "using namespace interpreter;\n\n"
+       << "static const char source[] =\n      " << escape(source) << ";\n\n"
+       << "int main() {\n"
+       << "   lexer::reset(source);\n"
+       << "   std::vector<lexer::tok_t> toks = lexer::lex();\n"
+       << "   if (!lexer::error.empty()) {\n      return 1;\n   }\n"
+       << "   interpreter::reset(toks);\n"
+       << (optimised ? "   ir::inline_limit = " + std::to_string(ir::inline_limit) + ";\n   ir::optimise();\n" : "")
+       << "   if (statements.size() != " << statements.size() << ") {\n"
+       << "      std::cout << \"aot: program does not match the one it was compiled from\";\n      return 1;\n   }\n"
+       << "   const std::vector<statement_t>& s = statements;\n"
+       << "   runtime_res_t res;\n   std::string error;\n   u32 ret = 0;\n";
+   for (u32 i = 0; i < 26; i++) {
+      if (slots[i]) {
+         out << "   " << type_name(kinds[i]);
+         for (u32 slot = 1; slot <= slots[i]; slot++) {
+            out << (slot == 1 ? " " : ", ") << stack_name(i) << slot << " = 0";
+         }
+         out << ";\n";
+      } else if (typed[i]) {
+         out << "   std::vector<" << type_name(kinds[i]) << "> " << stack_name(i) << ";\n";
+      }
+   }
+   out << '\n';
+
+   for (u32 i = 0; i < statements.size(); i++) {
+      if (targets.count(i)) {
+         out << "   " << label(i) << ":\n";
+      }
+      out << "   {\n";
+      emit_statement(out, i);
+      out << "   }\n";
+   }
+   out << "   end:\n   res = channel::join(false);\n"
+       << "   if (!res.second.empty()) { error = res.second; goto fail; }\n   std::cout.flush();\n   return 0;\n"
+       << "   fail:\n   res = channel::join(true);\n   if (!res.second.empty()) {\n      error = res.second;\n   }\n   std::cout << error;\n   return 1;\n}\n";
+   return out.good() ? "" : "aot::emit: could not write the generated code";
+}
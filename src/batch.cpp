@@ -0,0 +1,653 @@
+//
+// Batch mode: one program run over many inputs at once, a lane per input, in lockstep.
+//
+// every stack a-z is kept as columns, one per depth, each holding that slot of every lane, so the lanes
+// running a statement find their operands side by side. a char, integer or float is kept unboxed in the
+// column, anything else as the value the interpreter would have. each lane has its own depth in every
+// stack, its own statement to run next and its own jump back stack.
+//
+// lanes take turns by statement: of the lanes with the deepest jump back stack, the one furthest back in
+// the program runs next, along with every other lane at the same statement. lanes that split at a jump
+// run one side at a time until they meet again, and the lanes not at the statement are masked off. an
+// operation whose lanes all hold numbers of one type at the same depth of every stack it uses runs as
+// one loop over the whole batch, keeping only the results of the lanes at the statement. anything else
+// runs one lane at a time through the interpreter's own statements, on stacks holding just the tops the
+// statement uses, so every lane gets exactly what running it alone would.
+//
+
+#include <batch.h>
+#include <alloc.h>
+#include <algorithm>
+#include <iomanip>
+#include <cmath>
+#include <sstream>
+#include <iostream>
+
+using namespace interpreter;
+
+batch::stats_t batch::stats;
+
+// tag of a slot holding a boxed value, the numbers being tagged with their data_type_e
+static const u8 boxed = 0xff;
+
+// one depth of a stack, across every lane
+struct column_t {
+   std::vector<u8> tags;
+   std::vector<i64> ints;
+   std::vector<f64> fps;
+   std::vector<data_t> values;
+};
+
+struct lane_t {
+   u32 current = 0;
+   std::vector<u32> returns;
+   std::stringstream in, out;
+   bool running = false;
+   std::string error;
+};
+
+// an operand every lane at a vectorised statement has a number of the same type for, a literal or a
+// column
+struct operand_t {
+   u8 tag;
+   ptr(column_t) column;
+   i64 i;
+   f64 f;
+};
+
+// the batch running
+static u32 width;
+static std::vector<column_t> columns[26];
+static std::vector<u32> depths[26];
+static std::vector<lane_t> lanes;
+// whether each lane runs the statement running, and which lanes those are
+static std::vector<u8> mask;
+static std::vector<u32> active;
+// the stacks a lane runs a statement alone on
+static stack_t scratch[32];
+// operands and results of vectorised operations, a value per lane
+static std::vector<i64> ia, ib, ir;
+static std::vector<f64> fa, fb, fr;
+
+static void fail(u32 l, ref(std::string) error) {
+   lanes[l].running = false;
+   lanes[l].error = error;
+   mask[l] = 0;
+}
+
+// top of a lane's stack, boxed
+static data_t get(u32 s, u32 l) {
+   ref(column_t) col = columns[s][depths[s][l] - 1];
+   switch (col.tags[l]) {
+      case data_type_e::chr:
+         return data_t { data_type_e::chr, alloc::make<char>(alloc::conversion, (char) col.ints[l]) };
+      case data_type_e::integer:
+         return data_t { data_type_e::integer, alloc::make<i64>(alloc::conversion, col.ints[l]) };
+      case data_type_e::fp:
+         return data_t { data_type_e::fp, alloc::make<f64>(alloc::conversion, col.fps[l]) };
+      default:
+         return col.values[l];
+   }
+}
+
+// sets the top of a lane's stack, unboxing numbers
+static void put(u32 s, u32 l, ref(data_t) value) {
+   mutref(column_t) col = columns[s][depths[s][l] - 1];
+   if (value.data == nullptr || value.type > data_type_e::fp) {
+      col.tags[l] = boxed;
+      col.values[l] = value;
+      return;
+   }
+   col.tags[l] = value.type;
+   switch (value.type) {
+      case data_type_e::chr:
+         col.ints[l] = *(char*) value.data;
+         break;
+      case data_type_e::integer:
+         col.ints[l] = *(i64*) value.data;
+         break;
+      default:
+         col.fps[l] = *(f64*) value.data;
+   }
+}
+
+// index into a stack's columns of the top every active lane has, false when they differ or it is empty
+static bool level_of(u32 s, mutref(u32) level) {
+   u32 depth = depths[s][active[0]];
+   if (depth == 0) {
+      return false;
+   }
+   for (u32 l : active) {
+      if (depths[s][l] != depth) {
+         return false;
+      }
+   }
+   level = depth - 1;
+   return true;
+}
+
+static bool operand(ref(node_t) node, mutref(operand_t) out) {
+   switch (node.type) {
+      case lexer::chr:
+         out = operand_t { data_type_e::chr, nullptr, *(char*) node.data, (f64) *(char*) node.data };
+         return true;
+      case lexer::integer:
+         out = operand_t { data_type_e::integer, nullptr, *(i64*) node.data, (f64) *(i64*) node.data };
+         return true;
+      case lexer::fp:
+         out = operand_t { data_type_e::fp, nullptr, (i64) *(f64*) node.data, *(f64*) node.data };
+         return true;
+      case lexer::stack: {
+         u32 s = any_cast<u32>(node.data), level;
+         if (!level_of(s, level)) {
+            return false;
+         }
+         ref(column_t) col = columns[s][level];
+         u8 tag = col.tags[active[0]];
+         if (tag > data_type_e::fp) {
+            return false;
+         }
+         for (u32 l : active) {
+            if (col.tags[l] != tag) {
+               return false;
+            }
+         }
+         out = operand_t { tag, &col, 0, 0 };
+         return true;
+      }
+      default:
+         return false;
+   }
+}
+
+// an operand's value in every lane, converted as the interpreter's conversions do
+static void fill(ref(operand_t) in, mutref(std::vector<i64>) out) {
+   if (in.column == nullptr) {
+      std::fill(out.begin(), out.end(), in.i);
+   } else if (in.tag == data_type_e::fp) {
+      ref(std::vector<f64>) from = in.column->fps;
+      for (u32 l = 0; l < width; l++) {
+         out[l] = (i64) from[l];
+      }
+   } else {
+      std::copy(in.column->ints.begin(), in.column->ints.end(), out.begin());
+   }
+}
+
+static void fill(ref(operand_t) in, mutref(std::vector<f64>) out) {
+   if (in.column == nullptr) {
+      std::fill(out.begin(), out.end(), in.f);
+   } else if (in.tag == data_type_e::fp) {
+      std::copy(in.column->fps.begin(), in.column->fps.end(), out.begin());
+   } else {
+      ref(std::vector<i64>) from = in.column->ints;
+      for (u32 l = 0; l < width; l++) {
+         out[l] = (f64) from[l];
+      }
+   }
+}
+
+// writes the results of the active lanes that did not fail to the top of a stack
+static void store(u32 s, u32 level, u8 tag) {
+   mutref(column_t) col = columns[s][level];
+   for (u32 l : active) {
+      if (mask[l]) {
+         col.tags[l] = tag;
+         if (tag == data_type_e::fp) {
+            col.fps[l] = fr[l];
+         } else {
+            col.ints[l] = ir[l];
+         }
+      }
+   }
+}
+
+// `a b c op` over every lane at once, when the operands are numbers of one type in every lane. false
+// when it has to run a lane at a time
+static bool vectorised_op(ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   bool equality = op == lexer::eq || op == lexer::neq;
+   bool logic = op == lexer::and_ || op == lexer::or_ || op == lexer::xor_;
+   // comparisons of order and negated operands are left to the interpreter
+   if (stmt.size() != 4 || stmt[2].type != lexer::stack || op == lexer::gt || op == lexer::gte || op == lexer::lt
+         || op == lexer::lte) {
+      return false;
+   }
+   operand_t one { }, two { };
+   u32 dst = any_cast<u32>(stmt[2].data), level;
+   if (!operand(stmt[0], one) || !operand(stmt[1], two) || !level_of(dst, level)) {
+      return false;
+   }
+   if (equality && one.tag != two.tag) {
+      return false;
+   }
+   u8 dominant = op == lexer::idiv ? (u8) data_type_e::integer : std::max(one.tag, two.tag);
+   if (logic) {
+      fill(one, fa);
+      fill(two, fb);
+      for (u32 l = 0; l < width; l++) {
+         bool a = fa[l] != 0, b = fb[l] != 0;
+         ir[l] = op == lexer::and_ ? a && b : op == lexer::or_ ? a || b : a != b;
+      }
+      store(dst, level, data_type_e::chr);
+      return true;
+   }
+   if (dominant == data_type_e::fp) {
+      fill(one, fa);
+      fill(two, fb);
+      switch (op) {
+         case lexer::add:
+            for (u32 l = 0; l < width; l++) {
+               fr[l] = fa[l] + fb[l];
+            }
+            break;
+         case lexer::sub:
+            for (u32 l = 0; l < width; l++) {
+               fr[l] = fa[l] - fb[l];
+            }
+            break;
+         case lexer::mul:
+            for (u32 l = 0; l < width; l++) {
+               fr[l] = fa[l] * fb[l];
+            }
+            break;
+         case lexer::div:
+            for (u32 l = 0; l < width; l++) {
+               fr[l] = fa[l] / fb[l];
+            }
+            break;
+         case lexer::mod:
+            for (u32 l = 0; l < width; l++) {
+               fr[l] = fmod(fa[l], fb[l]);
+            }
+            break;
+         case lexer::eq:
+            for (u32 l = 0; l < width; l++) {
+               ir[l] = fa[l] == fb[l];
+            }
+            break;
+         case lexer::neq:
+            for (u32 l = 0; l < width; l++) {
+               ir[l] = fa[l] != fb[l];
+            }
+            break;
+         default:
+            return false;
+      }
+      store(dst, level, equality ? data_type_e::chr : data_type_e::fp);
+      return true;
+   }
+   fill(one, ia);
+   fill(two, ib);
+   if (op == lexer::div || op == lexer::idiv || op == lexer::mod) {
+      // the interpreter traps on these, a lane fails alone
+      for (u32 l : active) {
+         if (ib[l] == 0) {
+            fail(l, "interpreter::basic_op@" + lexer::to_string(op) + ": division by zero");
+         }
+      }
+      // lanes not running it may hold anything
+      for (u32 l = 0; l < width; l++) {
+         ib[l] = mask[l] ? ib[l] : 1;
+      }
+   }
+   switch (op) {
+      case lexer::add:
+         for (u32 l = 0; l < width; l++) {
+            ir[l] = ia[l] + ib[l];
+         }
+         break;
+      case lexer::sub:
+         for (u32 l = 0; l < width; l++) {
+            ir[l] = ia[l] - ib[l];
+         }
+         break;
+      case lexer::mul:
+         for (u32 l = 0; l < width; l++) {
+            ir[l] = ia[l] * ib[l];
+         }
+         break;
+      case lexer::div:
+      case lexer::idiv:
+         for (u32 l = 0; l < width; l++) {
+            ir[l] = ia[l] / ib[l];
+         }
+         break;
+      case lexer::mod:
+         for (u32 l = 0; l < width; l++) {
+            ir[l] = ia[l] % ib[l];
+         }
+         break;
+      case lexer::eq:
+         for (u32 l = 0; l < width; l++) {
+            ir[l] = ia[l] == ib[l];
+         }
+         break;
+      case lexer::neq:
+         for (u32 l = 0; l < width; l++) {
+            ir[l] = ia[l] != ib[l];
+         }
+         break;
+      default:
+         return false;
+   }
+   if (dominant == data_type_e::chr && !equality) {
+      // arithmetic on chars wraps as a char
+      for (u32 l = 0; l < width; l++) {
+         ir[l] = (char) ir[l];
+      }
+   }
+   store(dst, level, equality ? (u8) data_type_e::chr : dominant);
+   return true;
+}
+
+// `x a` over every lane at once, when x is a number of one type in every lane
+static bool vectorised_set(ref(statement_t) stmt) {
+   operand_t src { };
+   u32 dst = any_cast<u32>(stmt[stmt.size() - 1].data), level;
+   if (stmt.size() != 2 || !operand(stmt[0], src) || !level_of(dst, level)) {
+      return false;
+   }
+   if (src.tag == data_type_e::fp) {
+      fill(src, fr);
+   } else {
+      fill(src, ir);
+   }
+   store(dst, level, src.tag);
+   return true;
+}
+
+// runs the statement for one lane as the interpreter does, on stacks holding the tops of the lane's it
+// uses
+static void one_lane(ref(statement_t) stmt, u32 l) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   u32 used[8], count = 0;
+   for (ref(node_t) node : stmt) {
+      if (node.type == lexer::stack && count < 8) {
+         u32 s = any_cast<u32>(node.data);
+         if (std::find(used, used + count, s) == used + count) {
+            used[count++] = s;
+         }
+      }
+   }
+   for (u32 i = 0; i < count; i++) {
+      scratch[used[i]] = stack_t();
+      if (depths[used[i]][l] > 0) {
+         scratch[used[i]].push(get(used[i], l));
+      }
+   }
+   runtime_res_t res;
+   if (op == lexer::print || op == lexer::read) {
+      std::streambuf* in = std::cin.rdbuf(lanes[l].in.rdbuf());
+      std::streambuf* out = std::cout.rdbuf(lanes[l].out.rdbuf());
+      res = op == lexer::print ? exec_print(stmt) : exec_read(stmt);
+      std::cin.rdbuf(in);
+      std::cout.rdbuf(out);
+   } else if (op == lexer::stack) {
+      res = exec_set(stmt);
+   } else if (op == lexer::cast) {
+      res = exec_cast(stmt);
+   } else {
+      std::streambuf* out = std::cout.rdbuf(lanes[l].out.rdbuf());
+      res = exec_op(stmt);
+      std::cout.rdbuf(out);
+   }
+   if (!res.second.empty()) {
+      fail(l, res.second);
+      return;
+   }
+   for (u32 i = 0; i < count; i++) {
+      if (depths[used[i]][l] > 0 && !scratch[used[i]].empty()) {
+         put(used[i], l, scratch[used[i]].top());
+      }
+   }
+}
+
+static void push(u32 s) {
+   for (u32 l : active) {
+      u32 depth = depths[s][l]++;
+      if (depth == columns[s].size()) {
+         columns[s].push_back(column_t { std::vector<u8>(width, boxed), std::vector<i64>(width),
+                                         std::vector<f64>(width), std::vector<data_t>(width) });
+      }
+      columns[s][depth].tags[l] = boxed;
+      columns[s][depth].values[l] = data_t { };
+   }
+}
+
+static void pop(u32 s) {
+   for (u32 l : active) {
+      if (depths[s][l] == 0) {
+         fail(l, "interpreter::run@pop: stack trying to be popped is empty!");
+      } else {
+         depths[s][l]--;
+      }
+   }
+}
+
+// moves every lane at the jump on, each by its own condition
+static void jump(ref(statement_t) stmt, u32 at) {
+   bool neg = stmt[0].type == lexer::not_;
+   ref(node_t) cond = stmt[neg];
+   u32 target = any_cast<u32>(stmt[stmt.size() - 1].data);
+   bool tail = tail_call(at), literal = cond.type != lexer::stack, constant = false;
+   if (literal) {
+      runtime_res_t dat = value_of(cond);
+      constant = dat.second.empty() && is_true(dat.first);
+   }
+   u32 s = literal ? 0 : any_cast<u32>(cond.data);
+   for (u32 l : active) {
+      bool taken = constant;
+      if (!literal) {
+         if (depths[s][l] == 0) {
+            fail(l, "interpreter::node_to_data: stack is empty");
+            continue;
+         }
+         ref(column_t) col = columns[s][depths[s][l] - 1];
+         switch (col.tags[l]) {
+            case data_type_e::fp:
+               taken = col.fps[l] != 0;
+               break;
+            case boxed:
+               if (col.values[l].data == nullptr) {
+                  fail(l, "interpreter::run@jump: condition has no value");
+                  continue;
+               }
+               taken = is_true(col.values[l]);
+               break;
+            default:
+               taken = col.ints[l] != 0;
+         }
+      }
+      if (taken != neg) {
+         if (!tail) {
+            lanes[l].returns.push_back(at + 1);
+         }
+         lanes[l].current = target;
+      } else {
+         lanes[l].current = at + 1;
+      }
+   }
+}
+
+// picks the statement to run next and masks the lanes at it, false when every lane is done
+static bool pick(mutref(u32) at) {
+   bool any = false;
+   size_t deepest = 0;
+   for (u32 l = 0; l < width; l++) {
+      ref(lane_t) lane = lanes[l];
+      if (lane.running && (!any || lane.returns.size() > deepest
+            || (lane.returns.size() == deepest && lane.current < at))) {
+         any = true;
+         deepest = lane.returns.size();
+         at = lane.current;
+      }
+   }
+   active.clear();
+   for (u32 l = 0; l < width; l++) {
+      mask[l] = lanes[l].running && lanes[l].current == at;
+      if (mask[l]) {
+         active.push_back(l);
+      }
+   }
+   return any;
+}
+
+static void run_lanes() {
+   u32 at = 0;
+   while (pick(at)) {
+      ref(statement_t) stmt = statements[at];
+      lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      bool advance = true;
+      batch::stats.dispatches++;
+      batch::stats.laneStatements += active.size();
+      switch (op) {
+         case lexer::add:
+         case lexer::sub:
+         case lexer::mul:
+         case lexer::div:
+         case lexer::idiv:
+         case lexer::mod:
+         case lexer::eq:
+         case lexer::neq:
+         case lexer::gt:
+         case lexer::lt:
+         case lexer::gte:
+         case lexer::lte:
+         case lexer::and_:
+         case lexer::or_:
+         case lexer::xor_:
+            if (vectorised_op(stmt)) {
+               batch::stats.vectorised++;
+               break;
+            }
+            for (u32 l : active) {
+               one_lane(stmt, l);
+            }
+            break;
+         case lexer::stack:
+            if (vectorised_set(stmt)) {
+               batch::stats.vectorised++;
+               break;
+            }
+            for (u32 l : active) {
+               one_lane(stmt, l);
+            }
+            break;
+         case lexer::print:
+         case lexer::cast:
+         case lexer::read:
+            for (u32 l : active) {
+               one_lane(stmt, l);
+            }
+            break;
+         case lexer::push:
+            push(any_cast<u32>(stmt[0].data));
+            break;
+         case lexer::pop:
+            pop(any_cast<u32>(stmt[0].data));
+            break;
+         case lexer::jump:
+            jump(stmt, at);
+            advance = false;
+            break;
+         case lexer::beginf:
+            for (u32 l : active) {
+               lanes[l].current = any_cast<u32>(stmt[0].data);
+            }
+            advance = false;
+            break;
+         case lexer::endf:
+            for (u32 l : active) {
+               if (lanes[l].returns.empty()) {
+                  fail(l, "interpreter@endf: jump_back stack is empty!");
+                  continue;
+               }
+               lanes[l].current = lanes[l].returns.back();
+               lanes[l].returns.pop_back();
+            }
+            advance = false;
+            break;
+         default:
+            break;
+      }
+      for (u32 l : active) {
+         mutref(lane_t) lane = lanes[l];
+         if (advance && mask[l]) {
+            lane.current = at + 1;
+         }
+         if (lane.current >= statements.size()) {
+            lane.running = false;
+         }
+      }
+   }
+}
+
+std::string batch::supported() {
+   for (u32 i = 0; i < statements.size(); i++) {
+      lexer::tok_type_e op = statements[i][statements[i].size() - 1].type;
+      switch (op) {
+         case lexer::map:
+         case lexer::reduce:
+         case lexer::send:
+         case lexer::receive:
+         case lexer::spawn:
+         case lexer::coroutine:
+         case lexer::resume:
+         case lexer::yield:
+         case lexer::done:
+            return "batch::run@" + lexer::to_string(op) + ": cannot run in a batch"
+                   + (i < positions.size() ? ", at " + lexer::to_string(positions[i]) : "");
+         default:
+            break;
+      }
+   }
+   return "";
+}
+
+std::vector<batch::result_t> batch::run(ref(std::vector<std::string>) inputs, u32 count) {
+   std::vector<result_t> results(inputs.size());
+   mutptr(stack_t) saved = stacks;
+   stacks = scratch;
+   count = std::max(count, 1u);
+   for (u32 first = 0; first < inputs.size(); first += count) {
+      width = std::min<u32>(count, inputs.size() - first);
+      lanes.clear();
+      lanes.resize(width);
+      for (u32 s = 0; s < 26; s++) {
+         columns[s].clear();
+         depths[s].assign(width, 0);
+      }
+      mask.assign(width, 0);
+      for (mutptr(std::vector<i64>) it : { &ia, &ib, &ir }) {
+         it->assign(width, 0);
+      }
+      for (mutptr(std::vector<f64>) it : { &fa, &fb, &fr }) {
+         it->assign(width, 0);
+      }
+      for (u32 l = 0; l < width; l++) {
+         lanes[l].in.str(inputs[first + l]);
+         lanes[l].running = !statements.empty();
+      }
+      run_lanes();
+      for (u32 l = 0; l < width; l++) {
+         results[first + l] = result_t { lanes[l].out.str(), lanes[l].error };
+      }
+      stats.batches++;
+   }
+   stats.inputs += inputs.size();
+   stacks = saved;
+   return results;
+}
+
+void batch::report(mutref(std::ostream) out) {
+   out << "batch: " << stats.inputs << " inputs in " << stats.batches << " batches, " << stats.dispatches
+       << " dispatches running " << stats.laneStatements << " lane statements";
+   if (stats.dispatches != 0) {
+      std::ios::fmtflags flags = out.flags();
+      out << std::fixed << std::setprecision(1) << " (" << (f64) stats.laneStatements / (f64) stats.dispatches
+          << " lanes each, " << 100.0 * (f64) stats.vectorised / (f64) stats.dispatches << "% vectorised)";
+      out.flags(flags);
+   }
+   out << '\n';
+}
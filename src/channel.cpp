@@ -0,0 +1,196 @@
+//
+// Channels between functions of a program running at once, each on a thread of its own.
+//
+// there are 26 channels, named like the stacks. each is a bounded ring of cells, every cell carrying a
+// sequence number telling whether it is free to write for the current lap around the ring or holds a
+// value to read. senders and receivers claim a cell by compare and swap on the ring's head or tail and
+// publish it through its sequence number, so any number of threads send and receive without a lock.
+// a full or empty channel makes its sender or receiver spin, then yield, until it is not.
+//
+// stages are functions spawned onto threads of their own with copies of the stacks, like mapped
+// functions. the program's run waits for them all at its end, and an error anywhere cancels the waits
+// of everything else.
+//
+
+#include <channel.h>
+#include <alloc.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+using namespace interpreter;
+
+struct cell_t {
+   std::atomic<u64> sequence;
+   data_t value;
+};
+
+struct ring_t {
+   cell_t cells[channel::capacity];
+   alignas(64) std::atomic<u64> head;
+   alignas(64) std::atomic<u64> tail;
+
+   ring_t() : head(0), tail(0) {
+      for (u64 i = 0; i < channel::capacity; i++) {
+         cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   bool try_send(ref(data_t) in) {
+      u64 pos = head.load(std::memory_order_relaxed);
+      while (true) {
+         mutref(cell_t) cell = cells[pos % channel::capacity];
+         i64 lap = (i64) cell.sequence.load(std::memory_order_acquire) - (i64) pos;
+         if (lap < 0) {
+            return false;
+         }
+         if (lap == 0 && head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            cell.value = in;
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            return true;
+         }
+         if (lap > 0) {
+            pos = head.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+   bool try_receive(mutref(data_t) out) {
+      u64 pos = tail.load(std::memory_order_relaxed);
+      while (true) {
+         mutref(cell_t) cell = cells[pos % channel::capacity];
+         i64 lap = (i64) cell.sequence.load(std::memory_order_acquire) - (i64) (pos + 1);
+         if (lap < 0) {
+            return false;
+         }
+         if (lap == 0 && tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            out = cell.value;
+            cell.sequence.store(pos + channel::capacity, std::memory_order_release);
+            return true;
+         }
+         if (lap > 0) {
+            pos = tail.load(std::memory_order_relaxed);
+         }
+      }
+   }
+};
+
+static ring_t rings[26];
+// stages still running, and whether waiting on a channel should give up
+static std::atomic<u32> running(0);
+static std::atomic<bool> cancelled(false);
+static std::mutex stagesLock;
+static std::vector<std::thread> stages;
+static std::string stageError;
+// allocation counts of the stages that finished, for the thread joining them to take over
+static std::vector<std::vector<alloc::site_stats_t>> stageSites;
+static std::vector<u64> stageLive;
+// is this thread a stage
+static thread_local bool onStage = false;
+
+// spins, then yields, until attempt succeeds. false when cancelled or nothing could ever make it succeed
+template<typename attempt_t>
+static bool wait(attempt_t attempt) {
+   for (u32 tries = 0; !attempt(); tries++) {
+      if (cancelled.load(std::memory_order_relaxed)) {
+         return false;
+      }
+      // only a stage can send to the main program's channel or empty it
+      if (!onStage && running.load(std::memory_order_acquire) == 0) {
+         return attempt();
+      }
+      if (tries < 64) {
+         continue;
+      }
+      std::this_thread::yield();
+   }
+   return true;
+}
+
+runtime_res_t channel::send(ref(statement_t) stmt) {
+   runtime_res_t dat = value_of(stmt[0]);
+   if (!dat.second.empty()) {
+      return dat;
+   }
+   mutref(ring_t) ring = rings[any_cast<u32>(stmt[1].data)];
+   if (!wait([&]() { return ring.try_send(dat.first); })) {
+      return { empty_data_t, cancelled ? "interpreter::run@send: cancelled"
+                                       : "interpreter::run@send: channel is full and nothing is running to empty it" };
+   }
+   return { empty_data_t, "" };
+}
+
+runtime_res_t channel::receive(ref(statement_t) stmt) {
+   u32 idx = any_cast<u32>(stmt[0].data);
+   if (stacks[idx].empty()) {
+      return { empty_data_t, "interpreter::run@receive: stack trying to be received into is empty!" };
+   }
+   mutref(ring_t) ring = rings[any_cast<u32>(stmt[1].data)];
+   data_t value;
+   if (!wait([&]() { return ring.try_receive(value); })) {
+      return { empty_data_t, cancelled ? "interpreter::run@receive: cancelled"
+                                       : "interpreter::run@receive: channel is empty and nothing is running to send to it" };
+   }
+   stacks[idx].top() = value;
+   return { empty_data_t, "" };
+}
+
+runtime_res_t channel::spawn(ref(statement_t) stmt) {
+   u32 entry = any_cast<u32>(stmt[stmt.size() - 1].data);
+   if (entry == 0 || entry > statements.size()
+         || statements[entry - 1][statements[entry - 1].size() - 1].type != lexer::beginf) {
+      return { empty_data_t, "interpreter::run@spawn: spawned something that is not a function" };
+   }
+   std::vector<stack_t> copy(stacks, stacks + 32);
+   running.fetch_add(1, std::memory_order_release);
+   std::lock_guard<std::mutex> guard(stagesLock);
+   stages.emplace_back([entry](std::vector<stack_t> own) {
+      onStage = true;
+      stacks = own.data();
+      runtime_res_t res = call(entry);
+      std::lock_guard<std::mutex> guard(stagesLock);
+      // a stage giving up because something else failed first is not what went wrong
+      if (!res.second.empty() && !cancelled.exchange(true)) {
+         stageError = res.second;
+      }
+      stageSites.emplace_back(alloc::sites, alloc::sites + alloc::site_count);
+      stageLive.push_back(alloc::live);
+      running.fetch_sub(1, std::memory_order_release);
+   }, std::move(copy));
+   return { empty_data_t, "" };
+}
+
+runtime_res_t channel::join(bool cancel) {
+   if (cancel) {
+      cancelled.store(true, std::memory_order_relaxed);
+   }
+   // stages can spawn more stages while the first ones are joined
+   while (true) {
+      std::vector<std::thread> joining;
+      {
+         std::lock_guard<std::mutex> guard(stagesLock);
+         joining.swap(stages);
+      }
+      if (joining.empty()) {
+         break;
+      }
+      for (mutref(std::thread) it : joining) {
+         it.join();
+      }
+   }
+   for (u32 i = 0; i < stageSites.size(); i++) {
+      alloc::absorb(stageSites[i].data(), stageLive[i]);
+   }
+   stageSites.clear();
+   stageLive.clear();
+   std::string error;
+   error.swap(stageError);
+   cancelled.store(false, std::memory_order_relaxed);
+   // a later run starts with empty channels
+   data_t left;
+   for (mutref(ring_t) ring : rings) {
+      while (ring.try_receive(left)) { }
+   }
+   return { empty_data_t, error };
+}
@@ -0,0 +1,148 @@
+//
+// Coroutines: functions that run a piece at a time, taking turns with whoever resumes them on one thread.
+//
+// a coroutine is where it is in the program, its own jump back stack and a copy of the stacks a-z made
+// when it was created. resuming one swaps those in for the resumer's and runs the statements from where it
+// was, in a run nested in the resumer's, until a yield ends that run or the function returns. nothing
+// switches threads or machine stacks, and a coroutine that yields costs what one statement does.
+// coroutines can make and resume others, a yield always going back to the one that resumed it.
+//
+
+#include <coroutine.h>
+#include <alloc.h>
+#include <atomic>
+#include <map>
+#include <vector>
+
+using namespace interpreter;
+
+struct coroutine_t {
+   // the statements of the program it is in, as a thread can take turns running several, see session
+   ptr(statement_t) program;
+   u32 current;
+   std::vector<u32> returns;
+   std::vector<stack_t> stacks;
+   data_t yielded;
+   bool running, returned;
+};
+
+typedef std::map<u64, coroutine_t> table_t;
+
+// handles are never reused, so one taken off another thread or kept past its coroutine finds nothing
+static std::atomic<u64> nextHandle(1);
+// this thread's coroutines by handle
+static thread_local table_t table;
+// the coroutine this thread is running, a yield goes back to whoever resumed it
+static thread_local mutptr(coroutine_t) running = nullptr;
+
+static runtime_res_t find(u32 idx, ref(std::string) where, mutref(table_t::iterator) out) {
+   if (stacks[idx].empty()) {
+      return { empty_data_t, "interpreter::run@" + where + ": stack holding the coroutine is empty!" };
+   }
+   ref(data_t) handle = stacks[idx].top();
+   if (handle.type != data_type_e::integer || handle.data == nullptr
+         || (out = table.find(any_cast<i64>(handle.data))) == table.end() || out->second.program != statements.data()) {
+      return { empty_data_t, "interpreter::run@" + where + ": not the handle of a coroutine of this thread" };
+   }
+   return { empty_data_t, "" };
+}
+
+runtime_res_t coroutine::create(ref(statement_t) stmt) {
+   u32 dst = any_cast<u32>(stmt[0].data), entry = any_cast<u32>(stmt[1].data);
+   if (entry == 0 || entry > statements.size()
+         || statements[entry - 1][statements[entry - 1].size() - 1].type != lexer::beginf) {
+      return { empty_data_t, "interpreter::run@coroutine: made a coroutine of something that is not a function" };
+   }
+   if (stacks[dst].empty()) {
+      return { empty_data_t, "interpreter::run@coroutine: stack for the handle is empty!" };
+   }
+   u64 handle = nextHandle.fetch_add(1, std::memory_order_relaxed);
+   mutref(coroutine_t) co = table[handle];
+   co = coroutine_t { statements.data(), entry, { (u32) statements.size() }, { }, { }, false, false };
+   co.stacks.resize(32);
+   for (u32 s = 0; s < 26; s++) {
+      co.stacks[s] = stacks[s];
+   }
+   stacks[dst].top() = data_t { data_type_e::integer, alloc::make<i64>(alloc::arithmetic, (i64) handle) };
+   return { empty_data_t, "" };
+}
+
+runtime_res_t coroutine::resume(ref(statement_t) stmt) {
+   u32 dst = any_cast<u32>(stmt[1].data);
+   table_t::iterator it;
+   runtime_res_t found = find(any_cast<u32>(stmt[0].data), "resume", it);
+   if (!found.second.empty()) {
+      return found;
+   }
+   if (stacks[dst].empty()) {
+      return { empty_data_t, "interpreter::run@resume: stack resumed into is empty!" };
+   }
+   mutref(coroutine_t) co = it->second;
+   if (co.returned) {
+      return { empty_data_t, "interpreter::run@resume: coroutine has already returned" };
+   }
+   if (co.running) {
+      return { empty_data_t, "interpreter::run@resume: coroutine is already running" };
+   }
+   co.running = true;
+   mutptr(coroutine_t) outer = running;
+   mutptr(stack_t) saved = stacks;
+   running = &co;
+   stacks = co.stacks.data();
+   runtime_res_t res = run_from<policy_t>(co.current, co.returns);
+   stacks = saved;
+   running = outer;
+   co.running = false;
+   if (!res.second.empty()) {
+      return res;
+   }
+   if (co.current >= statements.size()) {
+      // only its handle is kept
+      co.returned = true;
+      co.returns = { };
+      co.stacks = { };
+      return { empty_data_t, "" };
+   }
+   stacks[dst].top() = co.yielded;
+   return { empty_data_t, "" };
+}
+
+runtime_res_t coroutine::yield(ref(statement_t) stmt) {
+   if (running == nullptr) {
+      return { empty_data_t, "interpreter::run@yield: only a coroutine can yield" };
+   }
+   runtime_res_t dat = value_of(stmt[0]);
+   if (!dat.second.empty()) {
+      return dat;
+   }
+   running->yielded = dat.first;
+   return { empty_data_t, "" };
+}
+
+runtime_res_t coroutine::done(ref(statement_t) stmt) {
+   u32 dst = any_cast<u32>(stmt[1].data);
+   table_t::iterator it;
+   runtime_res_t found = find(any_cast<u32>(stmt[0].data), "done", it);
+   if (!found.second.empty()) {
+      return found;
+   }
+   if (stacks[dst].empty()) {
+      return { empty_data_t, "interpreter::run@done: stack trying to be set is empty!" };
+   }
+   stacks[dst].top() = data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, it->second.returned) };
+   return { empty_data_t, "" };
+}
+
+u64 coroutine::mark() {
+   return nextHandle.load(std::memory_order_relaxed);
+}
+
+void coroutine::release(u64 from) {
+   table.erase(table.lower_bound(from), table.end());
+}
+
+void coroutine::reset() {
+   for (table_t::iterator it = table.begin(); it != table.end();) {
+      it = it->second.program == statements.data() ? table.erase(it) : std::next(it);
+   }
+}
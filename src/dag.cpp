@@ -0,0 +1,273 @@
+//
+// Straight-line regions of statements run in parallel, as far as the stacks they use let them.
+//
+// a region's statements are put in levels, each one past the level of the last statement it depends on,
+// so the statements of a level can all run once the levels before it have. levels run one after another,
+// the statements of each spread over parallel::each's threads, on the stacks of the thread running the
+// program. values are never changed once made except arrays, which operations append to in place, so the
+// arrays count as one more stack, written by operations that can append and read by every statement that
+// can be handed an array.
+//
+// whether a region is worth it is only known by running it. it runs on one thread and is timed the first
+// few times, and only a region that took long enough runs in parallel from then on.
+//
+// when a statement fails, the statements before it in the program that have not run yet still run, so
+// the output and error are the ones running the region on one thread gives.
+//
+
+#include <dag.h>
+#include <types.h>
+#include <parallel.h>
+#include <timing.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+using namespace interpreter;
+
+dag::stats_t dag::stats;
+std::vector<u32> dag::starting;
+
+// bit of the arrays, past those of the stacks a-z
+static const u32 arrays = 1u << 26;
+
+struct region_t {
+   // statements [first, last)
+   u32 first, last;
+   // the statements of every level, in program order
+   std::vector<std::vector<u32>> levels;
+   u32 runs;
+   // nanoseconds the runs on one thread took
+   u64 timed;
+   bool parallel;
+};
+
+static std::vector<region_t> regions;
+
+static bool member(u32 stmt) {
+   lexer::tok_type_e op = statements[stmt][statements[stmt].size() - 1].type;
+   switch (op) {
+      case lexer::stack:
+      case lexer::cast:
+      case lexer::print:
+      case lexer::read:
+      case lexer::push:
+      case lexer::pop:
+      case lexer::nop:
+         return true;
+      default:
+         return ir::is_op(op);
+   }
+}
+
+static bool may_be(u32 stmt, ref(node_t) in, types::mask_t mask) {
+   return (types::before(stmt, in) & mask) != 0;
+}
+
+// the stacks a statement reads and writes, a bit each
+static void uses(u32 at, mutref(u32) reads, mutref(u32) writes) {
+   ref(statement_t) stmt = statements[at];
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   std::vector<u32> operands = ir::operands(stmt);
+   reads = writes = 0;
+   for (u32 n : operands) {
+      if (stmt[n].type == lexer::stack) {
+         reads |= 1u << any_cast<u32>(stmt[n].data);
+      }
+      if (may_be(at, stmt[n], types::of(data_type_e::array))) {
+         reads |= arrays;
+      }
+   }
+   u32 written = ir::written(stmt);
+   if (written != ir::none) {
+      writes |= 1u << written;
+   }
+   // arithmetic appends to an array it is given first, comparisons and logic do not
+   bool arithmetic = op == lexer::add || op == lexer::sub || op == lexer::mul || op == lexer::div || op == lexer::idiv
+         || op == lexer::mod;
+   if (arithmetic && !operands.empty() && may_be(at, stmt[operands[0]], types::of(data_type_e::array))) {
+      writes |= arrays;
+   }
+}
+
+// can the statement take long, handling strings or arrays. sets, pushes and pops only move them
+static bool heavy(u32 at) {
+   ref(statement_t) stmt = statements[at];
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (!ir::is_op(op) && op != lexer::cast && op != lexer::print) {
+      return false;
+   }
+   for (u32 n : ir::operands(stmt)) {
+      if (may_be(at, stmt[n], types::of(data_type_e::str) | types::of(data_type_e::array))) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// does the statement print or read. comparing for equality prints the types it was given when they
+// differ
+static bool prints_or_reads(u32 at) {
+   ref(statement_t) stmt = statements[at];
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (op == lexer::eq || op == lexer::neq) {
+      std::vector<u32> operands = ir::operands(stmt);
+      i32 one = operands.size() == 2 ? types::single(at, stmt[operands[0]]) : -1;
+      return one == -1 || one != types::single(at, stmt[operands[1]]);
+   }
+   return op == lexer::print || op == lexer::read;
+}
+
+// puts statements [first, last) in levels, keeping them as a region when that lets two heavy statements
+// run at once
+static void consider(u32 first, u32 last) {
+   u32 count = last - first, depth = 0;
+   if (count < 2) {
+      return;
+   }
+   std::vector<u32> reads(count), writes(count), level(count, 0);
+   for (u32 k = 0; k < count; k++) {
+      uses(first + k, reads[k], writes[k]);
+      // output and input wait for everything before them
+      bool ordered = prints_or_reads(first + k);
+      for (u32 j = 0; j < k; j++) {
+         if (ordered || (writes[j] & (reads[k] | writes[k])) != 0 || (reads[j] & writes[k]) != 0) {
+            level[k] = std::max(level[k], level[j] + 1);
+         }
+      }
+      depth = std::max(depth, level[k] + 1);
+   }
+   region_t region { first, last, std::vector<std::vector<u32>>(depth), 0, 0, false };
+   for (u32 k = 0; k < count; k++) {
+      region.levels[level[k]].push_back(first + k);
+   }
+   bool worth = false;
+   for (ref(std::vector<u32>) it : region.levels) {
+      worth |= std::count_if(it.begin(), it.end(), heavy) >= 2;
+   }
+   if (!worth) {
+      return;
+   }
+   dag::starting[first] = regions.size();
+   regions.push_back(region);
+   dag::stats.regions++;
+}
+
+static runtime_res_t exec(u32 at) {
+   ref(statement_t) stmt = statements[at];
+   switch (stmt[stmt.size() - 1].type) {
+      case lexer::stack:
+         return exec_set(stmt);
+      case lexer::cast:
+         return exec_cast(stmt);
+      case lexer::print:
+         return exec_print(stmt);
+      case lexer::read:
+         return exec_read(stmt);
+      case lexer::push:
+         stacks[any_cast<u32>(stmt[0].data)].push(data_t { });
+         return { empty_data_t, "" };
+      case lexer::pop:
+         return exec_pop(stmt);
+      case lexer::nop:
+         return { empty_data_t, "" };
+      default:
+         return exec_op(stmt);
+   }
+}
+
+void dag::analyse() {
+   types::infer();
+   regions.clear();
+   starting.assign(statements.size(), ir::none);
+   stats = stats_t { };
+   // a jump's target starts a region, it can be entered there
+   std::vector<bool> target(statements.size() + 1, false);
+   for (ref(statement_t) stmt : statements) {
+      if (stmt[stmt.size() - 1].type == lexer::jump) {
+         target[std::min<u32>(any_cast<u32>(stmt[stmt.size() - 1].data), statements.size())] = true;
+      }
+   }
+   for (u32 first = 0; first < statements.size();) {
+      if (!member(first)) {
+         first++;
+         continue;
+      }
+      u32 last = first + 1;
+      while (last < statements.size() && member(last) && !target[last]) {
+         last++;
+      }
+      consider(first, last);
+      first = last;
+   }
+}
+
+bool dag::run(mutref(u32) current, mutref(std::string) error) {
+   mutref(region_t) region = regions[starting[current]];
+   if (region.runs < samples) {
+      region.runs++;
+      u64 started = timing::wall_ns();
+      for (u32 at = region.first; at < region.last; at++) {
+         runtime_res_t res = exec(at);
+         if (!res.second.empty()) {
+            error = res.second;
+            current = at;
+            return true;
+         }
+      }
+      region.timed += timing::wall_ns() - started;
+      if (region.runs == samples && region.timed / samples >= min_ns) {
+         region.parallel = true;
+         stats.parallel++;
+      }
+      current = region.last;
+      return true;
+   }
+   if (!region.parallel) {
+      return false;
+   }
+   mutptr(stack_t) shared = stacks;
+   // the first statement that failed, only those before it run from then on
+   std::atomic<u32> failed(region.last);
+   std::mutex errorLock;
+   for (ref(std::vector<u32>) level : region.levels) {
+      if (level.size() > 1) {
+         stats.statements += level.size();
+      }
+      parallel::each(level.size(), [&](u32, u32 idx) {
+         u32 at = level[idx];
+         if (at >= failed.load(std::memory_order_relaxed)) {
+            return;
+         }
+         mutptr(stack_t) saved = stacks;
+         stacks = shared;
+         runtime_res_t res = exec(at);
+         stacks = saved;
+         if (!res.second.empty()) {
+            std::lock_guard<std::mutex> guard(errorLock);
+            if (at < failed.load(std::memory_order_relaxed)) {
+               failed.store(at, std::memory_order_relaxed);
+               error = res.second;
+            }
+         }
+      });
+   }
+   stats.runs++;
+   current = std::min(failed.load(), region.last);
+   return true;
+}
+
+void dag::report(mutref(std::ostream) out) {
+   out << "dag: " << stats.regions << " regions with statements that can run at once, " << stats.parallel
+       << " worth running in parallel, run in parallel " << stats.runs << " times over " << stats.statements
+       << " statements\n";
+   for (ref(region_t) it : regions) {
+      u32 widest = 0;
+      for (ref(std::vector<u32>) level : it.levels) {
+         widest = std::max<u32>(widest, level.size());
+      }
+      out << "  statements " << it.first << "-" << it.last - 1 << ": " << it.levels.size() << " levels, "
+          << widest << " wide, " << (it.runs == 0 ? 0 : it.timed / it.runs / 1000) << "us on one thread, "
+          << (it.parallel ? "parallel" : "serial") << '\n';
+   }
+}
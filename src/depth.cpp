@@ -0,0 +1,201 @@
+//
+// Static stack-depth analysis of interpreter::statements, proving which stack accesses can never find
+// their stack empty.
+//
+// every stack's depth is abstracted to a range, starting at zero everywhere. the ranges flow along the
+// same edges ir::successors gives the CFG: a push or pop moves a stack's range by one, a taken jump
+// pushes onto the jump back stack and endf pops it. a statement only carries on when the stacks it uses
+// hold something, so those ranges start at one after it. ranges at a statement reached again and again
+// are widened, their bounds that keep moving giving way to zero and unbounded, so the analysis ends.
+//
+
+#include <depth.h>
+#include <ir.h>
+#include <lexer.h>
+#include <sstream>
+#include <algorithm>
+
+using namespace interpreter;
+
+depth::stats_t depth::stats;
+std::vector<depth::depths_t> depth::before;
+std::vector<bool> depth::reached;
+
+// visits to a statement before its ranges are widened
+static const u32 widen_after = 4;
+
+// the stacks a statement needs to hold something, in the order it uses them
+static std::vector<u32> uses(ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   std::vector<u32> out;
+   if (op == lexer::endf) {
+      out.push_back(jump_back);
+      return out;
+   }
+   if (op == lexer::push) {
+      return out;
+   }
+   for (u32 idx : ir::operands(stmt)) {
+      if (stmt[idx].type == lexer::stack && any_cast<u32>(stmt[idx].data) < jump_back) {
+         out.push_back(any_cast<u32>(stmt[idx].data));
+      }
+   }
+   u32 w = ir::written(stmt);
+   if (w != ir::none) {
+      out.push_back(w);
+   }
+   return out;
+}
+
+static void move(mutref(depth::range_t) in, i32 by) {
+   if (by > 0) {
+      in.lo++;
+      in.hi = in.hi == depth::unbounded ? depth::unbounded : in.hi + 1;
+   } else {
+      in.lo = in.lo == 0 ? 0 : in.lo - 1;
+      in.hi = in.hi == depth::unbounded || in.hi == 0 ? in.hi : in.hi - 1;
+   }
+}
+
+// joins depths flowing into a statement with what it already had, true when that changed it
+static bool join(u32 to, ref(depth::depths_t) in, ref(std::vector<u32>) visits) {
+   if (!depth::reached[to]) {
+      depth::reached[to] = true;
+      depth::before[to] = in;
+      return true;
+   }
+   bool changed = false, widen = visits[to] >= widen_after;
+   for (u32 s = 0; s <= jump_back; s++) {
+      mutref(depth::range_t) cur = depth::before[to][s];
+      if (in[s].lo < cur.lo) {
+         cur.lo = widen ? 0 : in[s].lo;
+         changed = true;
+      }
+      if (in[s].hi > cur.hi) {
+         cur.hi = widen ? depth::unbounded : in[s].hi;
+         changed = true;
+      }
+   }
+   return changed;
+}
+
+// is a jump taken, when its condition is a literal: 0 never, 1 always, -1 it depends
+static i32 known_cond(ref(statement_t) stmt) {
+   if (stmt[stmt[0].type == lexer::not_].type == lexer::stack) {
+      return -1;
+   }
+   runtime_res_t res = exec_cond(stmt);
+   return res.second.empty() ? is_true(res.first) : -1;
+}
+
+std::string depth::analyse() {
+   u32 size = statements.size();
+   stats = stats_t { };
+   before.assign(size, depths_t { });
+   reached.assign(size, false);
+   proven.assign(size, false);
+   if (size == 0) {
+      return "";
+   }
+
+   std::vector<u32> visits(size, 0), work;
+   std::vector<bool> queued(size, false);
+   auto flow = [&](u32 to, ref(depths_t) in) {
+      if (to < size && join(to, in, visits) && !queued[to]) {
+         queued[to] = true;
+         work.push_back(to);
+      }
+   };
+   join(0, depths_t { }, visits);
+   work.push_back(0);
+   queued[0] = true;
+   while (!work.empty()) {
+      u32 i = work.back();
+      work.pop_back();
+      queued[i] = false;
+      visits[i]++;
+
+      ref(statement_t) stmt = statements[i];
+      lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      depths_t cur = before[i];
+      bool stops = false;
+      for (u32 s : uses(stmt)) {
+         stops |= cur[s].hi == 0;
+         cur[s].lo = std::max(cur[s].lo, 1u);
+      }
+      if (stops) {
+         continue;
+      }
+      switch (op) {
+         case lexer::push:
+            move(cur[any_cast<u32>(stmt[0].data)], 1);
+            flow(i + 1, cur);
+            break;
+         case lexer::pop:
+            move(cur[any_cast<u32>(stmt[0].data)], -1);
+            flow(i + 1, cur);
+            break;
+         case lexer::jump: {
+            i32 known = known_cond(stmt);
+            if (known != 0) {
+               depths_t taken = cur;
+               if (!tail_call(i)) {
+                  move(taken[jump_back], 1);
+               }
+               flow(std::min(any_cast<u32>(stmt[stmt.size() - 1].data), size), taken);
+            }
+            if (known != 1) {
+               flow(i + 1, cur);
+            }
+            break;
+         }
+         case lexer::map:
+         case lexer::spawn:
+         case lexer::coroutine: {
+            // the function runs on copies of the stacks as they are here, returning to nowhere
+            depths_t called = cur;
+            move(called[jump_back], 1);
+            flow(std::min(any_cast<u32>(stmt[stmt.size() - 1].data), size), called);
+            flow(i + 1, cur);
+            break;
+         }
+         case lexer::endf:
+            move(cur[jump_back], -1);
+            // fall through
+         default:
+            for (u32 to : ir::successors(i)) {
+               flow(to, cur);
+            }
+      }
+   }
+
+   std::stringstream errors;
+   for (u32 i = 0; i < size; i++) {
+      if (!reached[i]) {
+         continue;
+      }
+      bool safe = true;
+      for (u32 s : uses(statements[i])) {
+         stats.accesses++;
+         if (before[i][s].lo > 0) {
+            stats.proven++;
+            continue;
+         }
+         safe = false;
+         if (before[i][s].hi == 0) {
+            errors << "depth::analyse: ";
+            if (s == jump_back) {
+               errors << "endf with nothing to return to";
+            } else {
+               errors << "stack " << (char) ('a' + s) << " is always empty here";
+            }
+            if (i < positions.size()) {
+               errors << '@' << lexer::to_string(positions[i]);
+            }
+            errors << '\n';
+         }
+      }
+      proven[i] = safe;
+   }
+   return errors.str();
+}
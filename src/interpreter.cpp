@@ -3,6 +3,17 @@
 //
 
 #include <interpreter.h>
+#include <profiler.h>
+#include <perf.h>
+#include <alloc.h>
+#include <trace.h>
+#include <memo.h>
+#include <parallel.h>
+#include <reduce.h>
+#include <channel.h>
+#include <coroutine.h>
+#include <session.h>
+#include <dag.h>
 #include <unordered_map>
 #include <stack>
 #include <cmath>
@@ -11,14 +22,16 @@
 
 using namespace interpreter;
 
-// 0-25 a-z, 26 jump back
-stack_t* interpreter::stacks;
-const u32 jump_back = 26;
+thread_local stack_t* interpreter::stacks;
 std::vector<statement_t> interpreter::statements;
+std::vector<lexer::file_pos_t> interpreter::positions;
+std::vector<bool> interpreter::proven;
+thread_local std::vector<u32> interpreter::returns;
 std::vector<std::pair<std::string, std::pair<u32, u32>>> resolve;
 std::vector<std::pair<std::string, std::pair<u32, u32>>> findEndfs;
 std::unordered_map<std::string, u32> endfs;
 std::unordered_map<std::string, u32> resolutions;
+thread_local u32 current = 0;
 
 bool interpreter::is_true(ref(data_t) in) {
    switch (in.type) {
@@ -42,8 +55,10 @@ node_t transform_tok(ref(lexer::tok_t) tok, u32 statementNum, u32 withinStmt) {
    switch (tok.type) {
       case lexer::push:
       case lexer::stack:
-      case lexer::pop: {
-         node.data = new u32(tok.content[0] - 'a');
+      case lexer::pop:
+      case lexer::send:
+      case lexer::receive: {
+         node.data = alloc::make<u32>(alloc::program, tok.content[0] - 'a');
          break;
       }
       case lexer::beginf:
@@ -56,40 +71,46 @@ node_t transform_tok(ref(lexer::tok_t) tok, u32 statementNum, u32 withinStmt) {
          endfs[tok.content] = statementNum + 1;
          break;
       }
-      case lexer::jump: {
+      case lexer::jump:
+      case lexer::map:
+      case lexer::spawn:
+      case lexer::coroutine: {
          resolve.push_back({ tok.content, { statementNum, withinStmt }});
          break;
       }
       case lexer::str:
       case lexer::id:
-         node.data = new std::string(tok.content);
+         node.data = alloc::make<std::string>(alloc::literal, tok.content);
          break;
       case lexer::chr: {
-         node.data = new char(tok.content[0]);
+         node.data = alloc::make<char>(alloc::literal, tok.content[0]);
          break;
       }
       case lexer::integer: {
-         node.data = new i64(std::strtoll(tok.content.c_str(), nullptr, 10));
+         node.data = alloc::make<i64>(alloc::literal, std::strtoll(tok.content.c_str(), nullptr, 10));
          break;
       }
       case lexer::fp: {
-         node.data = new f64(std::strtod(tok.content.c_str(), nullptr));
+         node.data = alloc::make<f64>(alloc::literal, std::strtod(tok.content.c_str(), nullptr));
          break;
       }
       case lexer::cast: {
          if (tok.content == "int") {
-            node.data = new data_type_e(integer);
+            node.data = alloc::make<data_type_e>(alloc::program, integer);
          } else if (tok.content == "float") {
-            node.data = new data_type_e(fp);
+            node.data = alloc::make<data_type_e>(alloc::program, fp);
          } else if (tok.content == "string") {
-            node.data = new data_type_e(str);
+            node.data = alloc::make<data_type_e>(alloc::program, str);
          } else if (tok.content == "char") {
-            node.data = new data_type_e(chr);
+            node.data = alloc::make<data_type_e>(alloc::program, chr);
          } else if (tok.content == "array") {
-            node.data = new data_type_e(array);
+            node.data = alloc::make<data_type_e>(alloc::program, array);
          }
          break;
       }
+      case lexer::reduce:
+         node.data = alloc::make<reduce::kind_e>(alloc::program, reduce::kind_of(tok.content));
+         break;
    }
    return node;
 }
@@ -103,11 +124,12 @@ convert conversions[] = {
             case data_type_e::chr:
                return { dat, "" };
             case data_type_e::integer:
-               return { data_t { chr, new char(any_cast<i64>(dat.data)) }, "" };
+               return { data_t { chr, alloc::make<char>(alloc::conversion, any_cast<i64>(dat.data)) }, "" };
             case data_type_e::fp:
-               return { data_t { chr, new char(any_cast<f64>(dat.data)) }, "" };
+               return { data_t { chr, alloc::make<char>(alloc::conversion, any_cast<f64>(dat.data)) }, "" };
             case data_type_e::str:
-               return { data_t { chr, new char(std::strtol(((std::string*) dat.data)->c_str(), nullptr, 10)) },
+               return { data_t { chr, alloc::make<char>(alloc::conversion,
+                        std::strtol(((std::string*) dat.data)->c_str(), nullptr, 10)) },
                         "" };
          }
          return { empty_data_t, "interpreter::convert@chr: cannot convert to char" };
@@ -115,13 +137,14 @@ convert conversions[] = {
       [](mutref(data_t) dat, lexer::tok_type_e op) -> runtime_res_t {
          switch (dat.type) {
             case data_type_e::chr:
-               return { data_t { integer, new i64(*(char*) dat.data) }, "" };
+               return { data_t { integer, alloc::make<i64>(alloc::conversion, *(char*) dat.data) }, "" };
             case data_type_e::integer:
                return { dat, "" };
             case data_type_e::fp:
-               return { data_t { integer, new i64(*(f64*) dat.data) }, "" };
+               return { data_t { integer, alloc::make<i64>(alloc::conversion, *(f64*) dat.data) }, "" };
             case data_type_e::str:
-               return { data_t { integer, new i64(std::strtoll(((std::string*) dat.data)->c_str(), nullptr, 10)) },
+               return { data_t { integer, alloc::make<i64>(alloc::conversion,
+                        std::strtoll(((std::string*) dat.data)->c_str(), nullptr, 10)) },
                         "" };
          }
          return { empty_data_t, "interpreter::convert@integer: cannot convert to integer" };
@@ -129,40 +152,51 @@ convert conversions[] = {
       [](mutref(data_t) dat, lexer::tok_type_e op) -> runtime_res_t {
          switch (dat.type) {
             case data_type_e::chr:
-               return { data_t { fp, new f64(*(char*) dat.data) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::conversion, *(char*) dat.data) }, "" };
             case data_type_e::integer:
-               return { data_t { fp, new f64(*(i64*) dat.data) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::conversion, *(i64*) dat.data) }, "" };
             case data_type_e::fp:
                return { dat, "" };
             case data_type_e::str:
-               return { data_t { fp, new f64(std::strtod(((std::string*) dat.data)->c_str(), nullptr)) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::conversion,
+                        std::strtod(((std::string*) dat.data)->c_str(), nullptr)) },
+                        "" };
          }
          return { empty_data_t, "interpreter::convert@fp: cannot convert to fp" };
       },
       [](mutref(data_t) dat, lexer::tok_type_e op) -> runtime_res_t {
          switch (dat.type) {
             case data_type_e::chr:
-               return { data_t { str, new std::string(1, *(char*) dat.data) }, "" };
+               return { data_t { str, alloc::make<std::string>(alloc::conversion, 1, *(char*) dat.data) }, "" };
             case data_type_e::integer: {
                if (op == lexer::mul) {
                   return { dat, "" };
                }
-               return { data_t { str, new std::string(std::to_string(*(i64*) dat.data)) }, "" };
+               return { data_t { str, alloc::make<std::string>(alloc::conversion, std::to_string(*(i64*) dat.data)) },
+                        "" };
             }
             case data_type_e::fp:
-               return { data_t { str, new std::string(std::to_string(*(f64*) dat.data)) }, "" };
+               return { data_t { str, alloc::make<std::string>(alloc::conversion, std::to_string(*(f64*) dat.data)) },
+                        "" };
             case data_type_e::str:
                return { dat, "" };
          }
          return { empty_data_t, "interpreter::convert@str: cannot convert to str" };
       },
       [](mutref(data_t) dat, lexer::tok_type_e op) -> runtime_res_t {
-         return { dat, "" };
+         if (dat.type == data_type_e::array) {
+            return { dat, "" };
+         }
+         // anything else becomes the first element of a new array
+         return { data_t { array, alloc::make<array_t>(alloc::conversion, 1, dat) }, "" };
       }
 };
 
 void interpreter::reset(ref(std::vector<lexer::tok_t>) tokens) {
+   coroutine::reset();
    statements.clear();
+   positions.clear();
+   proven.clear();
    statement_t temp;
    u32 i = 0;
    u32 statement = 0;
@@ -171,6 +205,7 @@ void interpreter::reset(ref(std::vector<lexer::tok_t>) tokens) {
       if (tokens[i].type == lexer::endl) {
          if (!temp.empty()) {
             statements.push_back(temp);
+            positions.push_back(tokens[i - withinStmt].filePos);
             statement++;
             temp = { };
             withinStmt = 0;
@@ -183,16 +218,19 @@ void interpreter::reset(ref(std::vector<lexer::tok_t>) tokens) {
       withinStmt++;
    }
    for (ref(auto) it : resolve) {
-      statements[it.second.first][it.second.second].data = new u32(resolutions[it.first]);
+      statements[it.second.first][it.second.second].data = alloc::make<u32>(alloc::program, resolutions[it.first]);
    }
    resolutions.clear();
    resolve.clear();
    for (ref(auto) it : findEndfs) {
-      statements[it.second.first][it.second.second].data = new u32(endfs[it.first]);
+      statements[it.second.first][it.second.second].data = alloc::make<u32>(alloc::program, endfs[it.first]);
    }
    findEndfs.clear();
    endfs.clear();
 
+   current = 0;
+   returns.clear();
+   delete[] interpreter::stacks;
    interpreter::stacks = new stack_t[32];
    for (int j = 0; j < 32; j++) {
       stack_t stack;
@@ -225,7 +263,9 @@ runtime_res_t basic_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
       u32 oidx = didx == 0 ? 1 : 0;
       if (dominant == data_type_e::array) {
          auto* arr = (array_t*) help[0].data;
+         u64 capacity = arr->capacity();
          arr->push_back(two);
+         alloc::grow(capacity * sizeof(data_t), arr->capacity() * sizeof(data_t));
          return { one, "" };
       }
       runtime_res_t conversion = conversions[dominant](help[oidx], op);
@@ -238,13 +278,17 @@ runtime_res_t basic_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
       case lexer::add: {
          switch (dominant) {
             case data_type_e::chr:
-               return { data_t { chr, new char(*(char*) help[0].data + *(char*) help[1].data) }, "" };
+               return { data_t { chr, alloc::make<char>(alloc::arithmetic, *(char*) help[0].data + *(char*) help[1].data) },
+                        "" };
             case data_type_e::integer:
-               return { data_t { integer, new i64(*(i64*) help[0].data + *(i64*) help[1].data) }, "" };
+               return { data_t { integer, alloc::make<i64>(alloc::arithmetic, *(i64*) help[0].data + *(i64*) help[1].data) },
+                        "" };
             case data_type_e::fp:
-               return { data_t { fp, new f64(*(f64*) help[0].data + *(f64*) help[1].data) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::arithmetic, *(f64*) help[0].data + *(f64*) help[1].data) },
+                        "" };
             case data_type_e::str:
-               return { data_t { str, new std::string(*(std::string*) help[0].data + *(std::string*) help[1].data) },
+               return { data_t { str, alloc::make<std::string>(alloc::arithmetic,
+                        *(std::string*) help[0].data + *(std::string*) help[1].data) },
                         "" };
          }
          break;
@@ -252,11 +296,14 @@ runtime_res_t basic_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
       case lexer::sub: {
          switch (dominant) {
             case data_type_e::chr:
-               return { data_t { chr, new char(*(char*) help[0].data - *(char*) help[1].data) }, "" };
+               return { data_t { chr, alloc::make<char>(alloc::arithmetic, *(char*) help[0].data - *(char*) help[1].data) },
+                        "" };
             case data_type_e::integer:
-               return { data_t { integer, new i64(*(i64*) help[0].data - *(i64*) help[1].data) }, "" };
+               return { data_t { integer, alloc::make<i64>(alloc::arithmetic, *(i64*) help[0].data - *(i64*) help[1].data) },
+                        "" };
             case data_type_e::fp:
-               return { data_t { fp, new f64(*(f64*) help[0].data - *(f64*) help[1].data) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::arithmetic, *(f64*) help[0].data - *(f64*) help[1].data) },
+                        "" };
             default:
                return { empty_data_t, "interpreter::basic_op@sub: cannot subtract non-numbers" };
          }
@@ -264,11 +311,14 @@ runtime_res_t basic_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
       case lexer::mul: {
          switch (dominant) {
             case data_type_e::chr:
-               return { data_t { chr, new char(*(char*) help[0].data * *(char*) help[1].data) }, "" };
+               return { data_t { chr, alloc::make<char>(alloc::arithmetic, *(char*) help[0].data * *(char*) help[1].data) },
+                        "" };
             case data_type_e::integer:
-               return { data_t { integer, new i64(*(i64*) help[0].data * *(i64*) help[1].data) }, "" };
+               return { data_t { integer, alloc::make<i64>(alloc::arithmetic, *(i64*) help[0].data * *(i64*) help[1].data) },
+                        "" };
             case data_type_e::fp:
-               return { data_t { fp, new f64(*(f64*) help[0].data * *(f64*) help[1].data) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::arithmetic, *(f64*) help[0].data * *(f64*) help[1].data) },
+                        "" };
             case data_type_e::str: {
                auto* str = (std::string*) help[0].data;
                i64 times = *(i64*) help[1].data;
@@ -276,7 +326,7 @@ runtime_res_t basic_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
                for (i64 i = 0; i < times; i++) {
                   res += *str;
                }
-               return { data_t { data_type_e::str, new std::string(res) }, "" };
+               return { data_t { data_type_e::str, alloc::make<std::string>(alloc::arithmetic, res) }, "" };
             }
             default:
                return { empty_data_t, "interpreter::basic_op@mul: cannot multiply non-numbers" };
@@ -285,25 +335,32 @@ runtime_res_t basic_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
       case lexer::div: {
          switch (dominant) {
             case data_type_e::chr:
-               return { data_t { chr, new char(*(char*) help[0].data / *(char*) help[1].data) }, "" };
+               return { data_t { chr, alloc::make<char>(alloc::arithmetic, *(char*) help[0].data / *(char*) help[1].data) },
+                        "" };
             case data_type_e::integer:
-               return { data_t { integer, new i64(*(i64*) help[0].data / *(i64*) help[1].data) }, "" };
+               return { data_t { integer, alloc::make<i64>(alloc::arithmetic, *(i64*) help[0].data / *(i64*) help[1].data) },
+                        "" };
             case data_type_e::fp:
-               return { data_t { fp, new f64(*(f64*) help[0].data / *(f64*) help[1].data) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::arithmetic, *(f64*) help[0].data / *(f64*) help[1].data) },
+                        "" };
             default:
                return { empty_data_t, "interpreter::basic_op@div: cannot divide non-numbers" };
          }
       }
       case lexer::idiv:
-         return { data_t { integer, new i64(*(i64*) help[0].data / *(i64*) help[1].data) }, "" };
+         return { data_t { integer, alloc::make<i64>(alloc::arithmetic, *(i64*) help[0].data / *(i64*) help[1].data) },
+                  "" };
       case lexer::mod: {
          switch (dominant) {
             case data_type_e::chr:
-               return { data_t { chr, new char(*(char*) help[0].data % *(char*) help[1].data) }, "" };
+               return { data_t { chr, alloc::make<char>(alloc::arithmetic, *(char*) help[0].data % *(char*) help[1].data) },
+                        "" };
             case data_type_e::integer:
-               return { data_t { integer, new i64(*(i64*) help[0].data % *(i64*) help[1].data) }, "" };
+               return { data_t { integer, alloc::make<i64>(alloc::arithmetic, *(i64*) help[0].data % *(i64*) help[1].data) },
+                        "" };
             case data_type_e::fp:
-               return { data_t { fp, new f64(fmod(*(f64*) help[0].data, *(f64*) help[1].data)) }, "" };
+               return { data_t { fp, alloc::make<f64>(alloc::arithmetic, fmod(*(f64*) help[0].data, *(f64*) help[1].data)) },
+                        "" };
             default:
                return { empty_data_t, "interpreter::basic_op@mod: cannot mod non-numbers" };
          }
@@ -323,39 +380,51 @@ runtime_res_t comp_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
       switch (one.type) {
          case data_type_e::chr:
             if (op == lexer::eq) {
-               return { data_t { data_type_e::chr, new char(any_cast<char>(one.data) == any_cast<char>(two.data)) },
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison,
+                        any_cast<char>(one.data) == any_cast<char>(two.data)) },
                         "" };
             } else {
-               return { data_t { data_type_e::chr, new char(any_cast<char>(one.data) != any_cast<char>(two.data)) },
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison,
+                        any_cast<char>(one.data) != any_cast<char>(two.data)) },
                         "" };
             }
          case data_type_e::integer:
             if (op == lexer::eq) {
-               return { data_t { data_type_e::chr, new char(any_cast<i64>(one.data) == any_cast<i64>(two.data)) }, "" };
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison,
+                        any_cast<i64>(one.data) == any_cast<i64>(two.data)) },
+                        "" };
             } else {
-               return { data_t { data_type_e::chr, new char(any_cast<i64>(one.data) != any_cast<i64>(two.data)) }, "" };
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison,
+                        any_cast<i64>(one.data) != any_cast<i64>(two.data)) },
+                        "" };
             }
          case data_type_e::fp:
             if (op == lexer::eq) {
-               return { data_t { data_type_e::chr, new char(any_cast<f64>(one.data) == any_cast<f64>(two.data)) }, "" };
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison,
+                        any_cast<f64>(one.data) == any_cast<f64>(two.data)) },
+                        "" };
             } else {
-               return { data_t { data_type_e::chr, new char(any_cast<f64>(one.data) != any_cast<f64>(two.data)) }, "" };
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison,
+                        any_cast<f64>(one.data) != any_cast<f64>(two.data)) },
+                        "" };
             }
             break;
          case data_type_e::str:
             if (op == lexer::eq) {
                return { data_t { data_type_e::chr,
-                                 new char(any_cast<std::string>(one.data) == any_cast<std::string>(two.data)) }, "" };
+                                 alloc::make<char>(alloc::comparison,
+                                          any_cast<std::string>(one.data) == any_cast<std::string>(two.data)) }, "" };
             } else {
                return { data_t { data_type_e::chr,
-                                 new char(any_cast<std::string>(one.data) != any_cast<std::string>(two.data)) }, "" };
+                                 alloc::make<char>(alloc::comparison,
+                                          any_cast<std::string>(one.data) != any_cast<std::string>(two.data)) }, "" };
             }
             break;
          case data_type_e::array:
             if (op == lexer::eq) {
-               return { data_t { data_type_e::chr, new char(one.data == two.data) }, "" };
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, one.data == two.data) }, "" };
             } else {
-               return { data_t { data_type_e::chr, new char(one.data != two.data) }, "" };
+               return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, one.data != two.data) }, "" };
             }
             break;
       }
@@ -397,16 +466,16 @@ runtime_res_t comp_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
 
    switch (op) {
       case lexer::gt:
-         one = data_t { data_type_e::integer, new i64(f1 > f2) };
+         one = data_t { data_type_e::integer, alloc::make<i64>(alloc::comparison, f1 > f2) };
          break;
       case lexer::lt:
-         one = data_t { data_type_e::integer, new i64(f1 < f2) };
+         one = data_t { data_type_e::integer, alloc::make<i64>(alloc::comparison, f1 < f2) };
          break;
       case lexer::gte:
-         one = data_t { data_type_e::integer, new i64(f1 >= f2) };
+         one = data_t { data_type_e::integer, alloc::make<i64>(alloc::comparison, f1 >= f2) };
          break;
       case lexer::lte:
-         one = data_t { data_type_e::integer, new i64(f1 <= f2) };
+         one = data_t { data_type_e::integer, alloc::make<i64>(alloc::comparison, f1 <= f2) };
          break;
       default:
          error = "interpreter::handle_comp_op: invalid comparison operator";
@@ -419,13 +488,17 @@ runtime_res_t comp_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e
 
 runtime_res_t logic_op(mutref(data_t) one, mutref(data_t) two, lexer::tok_type_e op) {
    switch (op) {
-      case lexer::and_: return { data_t { data_type_e::chr, new char(is_true(one) && is_true(two)) }, "" };
-      case lexer::or_: return { data_t { data_type_e::chr, new char(is_true(one) || is_true(two)) }, "" };
-      case lexer::xor_: return { data_t { data_type_e::chr, new char(is_true(one) != is_true(two)) }, "" };
+      case lexer::and_: return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, is_true(one) && is_true(two)) },
+                                 "" };
+      case lexer::or_: return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, is_true(one) || is_true(two)) },
+                                "" };
+      case lexer::xor_: return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, is_true(one) != is_true(two)) },
+                                 "" };
       default: return { empty_data_t, "interpreter::bool_op: invalid operator" };
    }
 }
 
+template<bool checked>
 runtime_res_t node_to_data(ref(node_t) in) {
    switch (in.type) {
       case lexer::integer:
@@ -439,8 +512,8 @@ runtime_res_t node_to_data(ref(node_t) in) {
       case lexer::array:
          return { data_t { data_type_e::array, in.data }, "" };
       case lexer::stack:
-         stack_t stack = interpreter::stacks[any_cast<u32>(in.data)];
-         if (stack.empty()) {
+         ref(stack_t) stack = interpreter::stacks[any_cast<u32>(in.data)];
+         if (checked && stack.empty()) {
             return { empty_data_t, "interpreter::node_to_data: stack is empty" };
          }
          return { stack.top(), "" };
@@ -450,21 +523,22 @@ runtime_res_t node_to_data(ref(node_t) in) {
 
 runtime_res_t negate(ref(data_t) in) {
    if (in.type == data_type_e::integer) {
-      return { data_t { data_type_e::integer, new i64(-any_cast<i64>(in.data)) }, "" };
+      return { data_t { data_type_e::integer, alloc::make<i64>(alloc::arithmetic, -any_cast<i64>(in.data)) }, "" };
    }
    if (in.type == data_type_e::fp) {
-      return { data_t { data_type_e::fp, new f64(-any_cast<f64>(in.data)) }, "" };
+      return { data_t { data_type_e::fp, alloc::make<f64>(alloc::arithmetic, -any_cast<f64>(in.data)) }, "" };
    }
    return { empty_data_t, "interpreter::negate: tried to negate non-number" };
 }
 
 runtime_res_t not_(ref(data_t) in) {
    if (is_true(in)) {
-      return { data_t { data_type_e::chr, new char(0) }, "" };
+      return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, 0) }, "" };
    }
-   return { data_t { data_type_e::chr, new char(1) }, "" };
+   return { data_t { data_type_e::chr, alloc::make<char>(alloc::comparison, 1) }, "" };
 }
 
+template<bool checked>
 runtime_res_t handle_op(ref(statement_t) stmt, lexer::tok_type_e op, operation todo) {
    std::string error;
    // pointers for the two values to be used in the operation
@@ -476,7 +550,7 @@ runtime_res_t handle_op(ref(statement_t) stmt, lexer::tok_type_e op, operation t
       // get the first value, negate it if necessary
       if (stmt[0].type == lexer::sub) {
          sidx++;
-         runtime_res_t cv0 = node_to_data(stmt[1]);
+         runtime_res_t cv0 = node_to_data<checked>(stmt[1]);
          if (!cv0.second.empty()) {
             error = cv0.second;
             goto Tail;
@@ -484,7 +558,7 @@ runtime_res_t handle_op(ref(statement_t) stmt, lexer::tok_type_e op, operation t
          runtime_res_t negated = negate(cv0.first);
          v1 = negated.first;
       } else {
-         runtime_res_t cv0 = node_to_data(stmt[0]);
+         runtime_res_t cv0 = node_to_data<checked>(stmt[0]);
          if (!cv0.second.empty()) {
             error = cv0.second;
             goto Tail;
@@ -494,7 +568,7 @@ runtime_res_t handle_op(ref(statement_t) stmt, lexer::tok_type_e op, operation t
 
       // get the second value, negate it if necessary
       if (stmt[sidx - 1].type == lexer::sub) {
-         runtime_res_t cv0 = node_to_data(stmt[1]);
+         runtime_res_t cv0 = node_to_data<checked>(stmt[1]);
          if (!cv0.second.empty()) {
             error = cv0.second;
             goto Tail;
@@ -502,7 +576,7 @@ runtime_res_t handle_op(ref(statement_t) stmt, lexer::tok_type_e op, operation t
          runtime_res_t negated = negate(cv0.first);
          v2 = negated.first;
       } else {
-         runtime_res_t cv0 = node_to_data(stmt[1]);
+         runtime_res_t cv0 = node_to_data<checked>(stmt[1]);
          if (!cv0.second.empty()) {
             error = cv0.second;
             goto Tail;
@@ -522,7 +596,7 @@ runtime_res_t handle_op(ref(statement_t) stmt, lexer::tok_type_e op, operation t
          goto Tail;
       }
       u32 idx = any_cast<u32>(stack.data);
-      if (interpreter::stacks[idx].empty()) {
+      if (checked && interpreter::stacks[idx].empty()) {
          error = "interpreter::run@basic_op: specified stack is empty";
          goto Tail;
       }
@@ -561,83 +635,200 @@ std::string to_string(ref(data_t) in) {
    }
 }
 
-u32 current = 0;
+operation operation_of(lexer::tok_type_e op) {
+   switch (op) {
+      case lexer::eq:
+      case lexer::neq:
+      case lexer::gt:
+      case lexer::lt:
+      case lexer::gte:
+      case lexer::lte:
+         return comp_op;
+      case lexer::and_:
+      case lexer::or_:
+      case lexer::xor_:
+         return logic_op;
+      default:
+         return basic_op;
+   }
+}
+
+template<bool checked>
+runtime_res_t interpreter::exec_op(ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   return handle_op<checked>(stmt, op, operation_of(op));
+}
 
-runtime_res_t interpreter::run() {
+runtime_res_t interpreter::compute(lexer::tok_type_e op, data_t one, data_t two) {
+   return operation_of(op)(one, two, op);
+}
+
+runtime_res_t interpreter::convert_to(data_t in, data_type_e to) {
+   return conversions[to](in, lexer::nop);
+}
+
+template<bool checked>
+runtime_res_t interpreter::exec_print(ref(statement_t) stmt) {
+   for (int i = 0; i < stmt.size() - 1; i++) {
+      runtime_res_t res = node_to_data<checked>(stmt[i]);
+      if (!res.second.empty()) {
+         return res;
+      }
+      std::cout << to_string(res.first);
+   }
+   return { empty_data_t, "" };
+}
+
+template<bool checked>
+runtime_res_t interpreter::exec_set(ref(statement_t) stmt) {
+   // replace top value of stack with constant
+   runtime_res_t dat = node_to_data<checked>(stmt[0]);
+   if (!dat.second.empty()) {
+      return dat;
+   }
+   u32 idx = any_cast<u32>(stmt[stmt.size() - 1].data);
+   if (checked && stacks[idx].empty()) {
+      return { empty_data_t, "interpreter::run@stack: stack trying to be set is empty!" };
+   }
+   interpreter::stacks[idx].pop();
+   interpreter::stacks[idx].push(dat.first);
+   return { empty_data_t, "" };
+}
+
+template<bool checked>
+runtime_res_t interpreter::exec_cast(ref(statement_t) stmt) {
+   runtime_res_t dat = node_to_data<checked>(stmt[0]);
+   if (!dat.second.empty()) {
+      return dat;
+   }
+   data_type_e type = any_cast<data_type_e>(stmt[2].data);
+   runtime_res_t res = conversions[type](dat.first, lexer::nop);
+   if (!res.second.empty()) {
+      return res;
+   }
+   u32 idx = any_cast<u32>(stmt[1].data);
+   if (checked && stacks[idx].empty()) {
+      return { empty_data_t, "interpreter::run@cast: stack trying to be cast to is empty!" };
+   }
+   interpreter::stacks[idx].top() = res.first;
+   return { empty_data_t, "" };
+}
+
+template<bool checked>
+runtime_res_t interpreter::exec_read(ref(statement_t) stmt) {
+   u32 idx = any_cast<u32>(stmt[0].data);
+   if (checked && stacks[idx].empty()) {
+      return { empty_data_t, "interpreter::run@read: stack trying to be read into is empty!" };
+   }
+   std::string in;
+   std::cin >> in;
+   data_t dat = { data_type_e::str, alloc::make<std::string>(alloc::read, in) };
+   interpreter::stacks[idx].top() = dat;
+   return { empty_data_t, "" };
+}
+
+template<bool checked>
+runtime_res_t interpreter::exec_cond(ref(statement_t) stmt) {
+   bool neg = false;
+   if (stmt[0].type == lexer::not_) { // handle negation
+      neg = true;
+   }
+   runtime_res_t dat = node_to_data<checked>(stmt[neg]);
+   if (neg && dat.second.empty()) {
+      dat = not_(dat.first);
+   }
+   return dat;
+}
+
+runtime_res_t interpreter::value_of(ref(node_t) in) {
+   return node_to_data<true>(in);
+}
+
+runtime_res_t interpreter::exec_pop(ref(statement_t) stmt) {
+   u32 idx = any_cast<u32>(stmt[0].data);
+   if (stacks[idx].empty()) {
+      return { empty_data_t, "interpreter::run@pop: stack trying to be popped is empty!" };
+   }
+   interpreter::stacks[idx].pop();
+   return { empty_data_t, "" };
+}
+
+void interpreter::push_return(u32 to) {
+   returns.push_back(to);
+}
+
+template<bool checked>
+runtime_res_t interpreter::pop_return(mutref(u32) to) {
+   // jump to the top of the jumpback stack & pop it
+   if (checked && returns.empty()) {
+      return { empty_data_t, "interpreter@endf: jump_back stack is empty!" };
+   }
+   to = returns.back();
+   returns.pop_back();
+   return { empty_data_t, "" };
+}
+
+template runtime_res_t interpreter::exec_op<true>(ref(statement_t));
+template runtime_res_t interpreter::exec_op<false>(ref(statement_t));
+template runtime_res_t interpreter::exec_print<true>(ref(statement_t));
+template runtime_res_t interpreter::exec_print<false>(ref(statement_t));
+template runtime_res_t interpreter::exec_set<true>(ref(statement_t));
+template runtime_res_t interpreter::exec_set<false>(ref(statement_t));
+template runtime_res_t interpreter::exec_cast<true>(ref(statement_t));
+template runtime_res_t interpreter::exec_cast<false>(ref(statement_t));
+template runtime_res_t interpreter::exec_read<true>(ref(statement_t));
+template runtime_res_t interpreter::exec_read<false>(ref(statement_t));
+template runtime_res_t interpreter::exec_cond<true>(ref(statement_t));
+template runtime_res_t interpreter::exec_cond<false>(ref(statement_t));
+template runtime_res_t interpreter::pop_return<true>(mutref(u32));
+template runtime_res_t interpreter::pop_return<false>(mutref(u32));
+
+template<typename policy_t>
+runtime_res_t interpreter::run_with() {
    std::string error;
    while (current < statements.size()) {
-      statement_t stmt = statements[current];
+      if (policy_t::suspend(current)) {
+         break;
+      }
+      if (policy_t::region(current, error)) {
+         if (!error.empty()) {
+            goto Tail;
+         }
+         continue;
+      }
+      ref(statement_t) stmt = statements[current];
       lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      u32 executing = current;
+      bool checked = policy_t::worker || current >= proven.size() || !proven[current];
+      u64 started = policy_t::begin(executing);
+      runtime_res_t res;
       switch (op) {
          case lexer::add:
          case lexer::sub:
          case lexer::mul:
          case lexer::div:
          case lexer::idiv:
-         case lexer::mod: {
-            runtime_res_t res = handle_op(stmt, op, basic_op);
-            if (!res.second.empty()) {
-               error = res.second;
-               goto Tail;
-            }
-            current++;
-            break;
-         }
+         case lexer::mod:
          case lexer::eq:
          case lexer::neq:
          case lexer::gt:
          case lexer::lt:
          case lexer::gte:
-         case lexer::lte: {
-            runtime_res_t res = handle_op(stmt, op, comp_op);
-            if (!res.second.empty()) {
-               error = res.second;
-               goto Tail;
-            }
-            current++;
-            break;
-         }
+         case lexer::lte:
          case lexer::and_:
          case lexer::or_:
-         case lexer::xor_: {
-            runtime_res_t res = handle_op(stmt, op, logic_op);
-            if (!res.second.empty()) {
-               error = res.second;
-               goto Tail;
-            }
+         case lexer::xor_:
+            res = checked ? exec_op(stmt) : exec_op<false>(stmt);
             current++;
             break;
-         }
-         case lexer::print: {
-            for (int i = 0; i < stmt.size() - 1; i++) {
-               runtime_res_t res = node_to_data(stmt[i]);
-               if (!res.second.empty()) {
-                  error = res.second;
-                  goto Tail;
-               }
-               data_t dat = res.first;
-               std::cout << to_string(dat);
-            }
+         case lexer::print:
+            res = checked ? exec_print(stmt) : exec_print<false>(stmt);
             current++;
             break;
-         }
-         case lexer::stack: {
-            // replace top value of stack with constant
-            runtime_res_t dat = node_to_data(stmt[0]);
-            if (!dat.second.empty()) {
-               error = dat.second;
-               goto Tail;
-            }
-            u32 idx = any_cast<u32>(stmt[stmt.size() - 1].data);
-            if (stacks[idx].empty()) {
-               error = "interpreter::run@stack: stack trying to be set is empty!";
-               goto Tail;
-            }
-            interpreter::stacks[idx].pop();
-            interpreter::stacks[idx].push(dat.first);
+         case lexer::stack:
+            res = checked ? exec_set(stmt) : exec_set<false>(stmt);
             current++;
             break;
-         }
          case lexer::push: {
             // new slot in stack
             interpreter::stacks[any_cast<u32>(stmt[0].data)].push(data_t { });
@@ -646,27 +837,31 @@ runtime_res_t interpreter::run() {
          }
          case lexer::pop: {
             // remove top value of stack
-            interpreter::stacks[any_cast<u32>(stmt[0].data)].pop();
+            if (checked) {
+               res = exec_pop(stmt);
+            } else {
+               interpreter::stacks[any_cast<u32>(stmt[0].data)].pop();
+            }
             current++;
             break;
          }
          case lexer::jump: {
-            runtime_res_t dat;
-            bool neg = false;
-            if (stmt[0].type == lexer::not_) { // handle negation
-               neg = true;
-            }
-            dat = node_to_data(stmt[neg]);
-            if (neg) {
-               dat = not_(dat.first);
-            }
-            if (!dat.second.empty()) {
-               error = dat.second;
-               goto Tail;
+            res = checked ? exec_cond(stmt) : exec_cond<false>(stmt);
+            if (!res.second.empty()) {
+               break;
             }
-            if (is_true(dat.first)) {
-               interpreter::stacks[jump_back].push({ data_type_e::integer, new u32(current + 1) });
+            if (is_true(res.first)) {
+               if (policy_t::call(current)) {
+                  current++;
+                  break;
+               }
+               if (!tail_call(current)) {
+                  push_return(current + 1);
+               }
                current = any_cast<u32>(stmt[stmt.size() - 1].data);
+               if (current <= executing) {
+                  policy_t::back_edge(executing, current, res.second);
+               }
             } else {
                current++;
             }
@@ -678,44 +873,125 @@ runtime_res_t interpreter::run() {
             current = endfLoc;
             break;
          }
-         case lexer::endf: {
-            // jump to the top of the jumpback stack & pop it
-            if (interpreter::stacks[jump_back].empty()) {
-               error = "interpreter@endf: jump_back stack is empty!";
-               goto Tail;
-            }
-            current = any_cast<u32>(interpreter::stacks[jump_back].top().data);
-            interpreter::stacks[jump_back].pop();
+         case lexer::endf:
+            res = checked ? pop_return(current) : pop_return<false>(current);
+            policy_t::returned();
             break;
-         }
-         case lexer::cast: {
-            runtime_res_t dat = node_to_data(stmt[0]);
-            if (!dat.second.empty()) {
-               error = dat.second;
-               goto Tail;
-            }
-            data_type_e type = any_cast<data_type_e>(stmt[2].data);
-            runtime_res_t res = conversions[type](dat.first, lexer::nop);
-            if (!res.second.empty()) {
-               error = res.second;
-               goto Tail;
+         case lexer::cast:
+            res = checked ? exec_cast(stmt) : exec_cast<false>(stmt);
+            current++;
+            break;
+         case lexer::read:
+            res = checked ? exec_read(stmt) : exec_read<false>(stmt);
+            current++;
+            break;
+         case lexer::map:
+            res = parallel::map(stmt);
+            current++;
+            break;
+         case lexer::reduce:
+            res = reduce::exec(stmt);
+            current++;
+            break;
+         case lexer::send:
+            res = channel::send(stmt);
+            current++;
+            break;
+         case lexer::receive:
+            res = channel::receive(stmt);
+            current++;
+            break;
+         case lexer::spawn:
+            if (policy_t::suspends) {
+               res = { empty_data_t, "interpreter::run@spawn: a program run a step at a time cannot spawn" };
+               break;
             }
-            interpreter::stacks[any_cast<u32>(stmt[1].data)].top() = res.first;
+            res = channel::spawn(stmt);
             current++;
             break;
-         }
-         case lexer::read: {
-            std::string in;
-            std::cin >> in;
-            data_t dat = { data_type_e::str, new std::string(in) };
-            interpreter::stacks[any_cast<u32>(stmt[0].data)].top() = dat;
+         case lexer::coroutine:
+            res = coroutine::create(stmt);
             current++;
             break;
-         }
+         case lexer::resume:
+            res = coroutine::resume(stmt);
+            current++;
+            break;
+         case lexer::done:
+            res = coroutine::done(stmt);
+            current++;
+            break;
+         case lexer::yield:
+            if (!policy_t::yields) {
+               res = { empty_data_t, "interpreter::run@yield: only a coroutine can yield" };
+               break;
+            }
+            res = coroutine::yield(stmt);
+            current++;
+            if (res.second.empty()) {
+               // back to whoever resumed the coroutine
+               goto Tail;
+            }
+            break;
          default:
             current++;
       }
+      if (!res.second.empty()) {
+         error = res.second;
+         goto Tail;
+      }
+      policy_t::end(executing, started);
    }
    Tail:
+   if (!policy_t::worker && !policy_t::suspends) {
+      // stages still running finish before the run does, given up on if it failed
+      runtime_res_t joined = channel::join(!error.empty());
+      if (!joined.second.empty()) {
+         error = joined.second;
+      }
+   }
+   if (alloc::reporting && !policy_t::worker && !policy_t::suspends) {
+      std::cout.flush();
+      alloc::report(std::cerr);
+   }
    return { data_t { }, error };
-}
\ No newline at end of file
+}
+
+template runtime_res_t interpreter::run_with<no_policy_t>();
+template runtime_res_t interpreter::run_with<profiler::policy_t>();
+template runtime_res_t interpreter::run_with<perf::count_policy_t>();
+template runtime_res_t interpreter::run_with<trace::policy_t>();
+template runtime_res_t interpreter::run_with<memo::policy_t>();
+template runtime_res_t interpreter::run_with<parallel::worker_policy_t>();
+template runtime_res_t interpreter::run_with<coroutine::policy_t>();
+template runtime_res_t interpreter::run_with<session::policy_t>();
+template runtime_res_t interpreter::run_with<dag::policy_t>();
+
+runtime_res_t interpreter::run() {
+   return run_with<no_policy_t>();
+}
+
+template<typename policy_t>
+runtime_res_t interpreter::run_from(mutref(u32) at, mutref(std::vector<u32>) jumpBacks) {
+   u32 savedCurrent = current;
+   returns.swap(jumpBacks);
+   current = at;
+   runtime_res_t res = run_with<policy_t>();
+   at = current;
+   returns.swap(jumpBacks);
+   current = savedCurrent;
+   return res;
+}
+
+template runtime_res_t interpreter::run_from<parallel::worker_policy_t>(mutref(u32), mutref(std::vector<u32>));
+template runtime_res_t interpreter::run_from<coroutine::policy_t>(mutref(u32), mutref(std::vector<u32>));
+template runtime_res_t interpreter::run_from<session::policy_t>(mutref(u32), mutref(std::vector<u32>));
+
+runtime_res_t interpreter::call(u32 entry) {
+   // returning from the function ends the run
+   std::vector<u32> own { (u32) statements.size() };
+   u64 made = coroutine::mark();
+   runtime_res_t res = run_from<parallel::worker_policy_t>(entry, own);
+   coroutine::release(made);
+   return res;
+}
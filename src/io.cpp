@@ -0,0 +1,410 @@
+//
+// Asynchronous stdin and stdout, so reads and prints do not wait on the file descriptors.
+//
+// std::cin and std::cout get stream buffers of their own. input is read a chunk at a time, and with
+// io_uring the read of the next chunk is submitted as soon as the program starts on the one before, so it
+// arrives while the program works. output goes into one of a few chunk sized buffers, a full one queued
+// for writing while the program goes on into the next, so a print only waits when every buffer is still
+// waiting to be written. stdin and stdout are streams, where reads or writes in flight at once could land
+// out of order, so there is at most one of each in flight. the blocking backend does the same with plain
+// read and write at the point they would be submitted, reading only once the program wants more.
+//
+// before waiting for input, whatever was printed is sent on its way, as it may be what the input is an
+// answer to. std::cin is not tied to std::cout meanwhile, so reading does not flush every time.
+//
+
+#include <io.h>
+#include <timing.h>
+#include <iostream>
+#include <streambuf>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define STACK_IO_URING
+#endif
+
+io::stats_t io::stats;
+io::backend_e io::backend = io::off;
+
+enum direction_e {
+   input,
+   output
+};
+
+// the read and the write in flight, and what they came back with, -errno on failure
+struct op_t {
+   bool pending;
+   i64 result;
+};
+
+static op_t ops[2];
+// held by everything here, prints can come from the threads of a map
+static std::mutex lock;
+
+#ifdef STACK_IO_URING
+
+struct ring_t {
+   int fd = -1;
+   mutptr(void) rings = nullptr;
+   mutptr(void) entries = nullptr;
+   size_t ringsSize = 0, entriesSize = 0;
+   mutptr(u32) sqTail;
+   mutptr(u32) sqMask;
+   mutptr(u32) sqArray;
+   mutptr(io_uring_sqe) sqes;
+   mutptr(u32) cqHead;
+   mutptr(u32) cqTail;
+   mutptr(u32) cqMask;
+   mutptr(io_uring_cqe) cqes;
+};
+
+static ring_t ring;
+
+static bool ring_setup() {
+   io_uring_params params { };
+   i32 fd = (i32) syscall(__NR_io_uring_setup, 4, &params);
+   if (fd < 0) {
+      return false;
+   }
+   // reads and writes at the file position, and both rings in one mapping
+   if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      close(fd);
+      return false;
+   }
+   ring.fd = fd;
+   ring.ringsSize = std::max(params.sq_off.array + params.sq_entries * sizeof(u32),
+                             params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+   ring.entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+   ring.rings = mmap(nullptr, ring.ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                     IORING_OFF_SQ_RING);
+   ring.entries = mmap(nullptr, ring.entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQES);
+   if (ring.rings == MAP_FAILED || ring.entries == MAP_FAILED) {
+      close(fd);
+      ring = ring_t { };
+      return false;
+   }
+   mutptr(char) base = (mutptr(char)) ring.rings;
+   ring.sqTail = (mutptr(u32)) (base + params.sq_off.tail);
+   ring.sqMask = (mutptr(u32)) (base + params.sq_off.ring_mask);
+   ring.sqArray = (mutptr(u32)) (base + params.sq_off.array);
+   ring.sqes = (mutptr(io_uring_sqe)) ring.entries;
+   ring.cqHead = (mutptr(u32)) (base + params.cq_off.head);
+   ring.cqTail = (mutptr(u32)) (base + params.cq_off.tail);
+   ring.cqMask = (mutptr(u32)) (base + params.cq_off.ring_mask);
+   ring.cqes = (mutptr(io_uring_cqe)) (base + params.cq_off.cqes);
+   return true;
+}
+
+static void ring_submit(direction_e dir, i32 fd, mutptr(char) buf, u32 len) {
+   u32 tail = *ring.sqTail, idx = tail & *ring.sqMask;
+   mutref(io_uring_sqe) sqe = ring.sqes[idx];
+   memset(&sqe, 0, sizeof(sqe));
+   sqe.opcode = dir == input ? IORING_OP_READ : IORING_OP_WRITE;
+   sqe.fd = fd;
+   sqe.addr = (u64) buf;
+   sqe.len = len;
+   sqe.off = (u64) -1;
+   sqe.user_data = dir;
+   ring.sqArray[idx] = idx;
+   __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+   if (syscall(__NR_io_uring_enter, ring.fd, 1, 0, 0, nullptr, 0) < 0) {
+      ops[dir] = op_t { false, -errno };
+   }
+}
+
+// takes every completion there is, first waiting for one when wait
+static void ring_reap(bool wait) {
+   if (wait) {
+      syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+   }
+   u32 head = *ring.cqHead, tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+   for (; head != tail; head++) {
+      ref(io_uring_cqe) cqe = ring.cqes[head & *ring.cqMask];
+      ops[cqe.user_data] = op_t { false, cqe.res };
+   }
+   __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+}
+
+static void ring_close() {
+   munmap(ring.rings, ring.ringsSize);
+   munmap(ring.entries, ring.entriesSize);
+   // a read still in flight is cancelled
+   close(ring.fd);
+   ring = ring_t { };
+}
+
+#endif
+
+// starts a read into buf or a write of it, the blocking backend doing it there and then
+static void submit(direction_e dir, mutptr(char) buf, u32 len) {
+   ops[dir].pending = true;
+   if (dir == input) {
+      io::stats.reads++;
+   } else {
+      io::stats.writes++;
+   }
+#ifdef STACK_IO_URING
+   if (io::backend == io::uring) {
+      ring_submit(dir, dir == input ? 0 : 1, buf, len);
+      return;
+   }
+#endif
+   i64 res;
+   do {
+      res = dir == input ? ::read(0, buf, len) : ::write(1, buf, len);
+   } while (res < 0 && errno == EINTR);
+   ops[dir] = op_t { false, res < 0 ? -errno : res };
+}
+
+// whether the read or write is done, waiting for it when wait
+static bool complete(direction_e dir, bool wait) {
+#ifdef STACK_IO_URING
+   if (io::backend == io::uring && ops[dir].pending) {
+      ring_reap(false);
+      while (wait && ops[dir].pending) {
+         ring_reap(true);
+      }
+   }
+#endif
+   return !ops[dir].pending;
+}
+
+struct out_buf_t : std::streambuf {
+   std::vector<char> buffers[io::out_buffers];
+   u32 sizes[io::out_buffers];
+   // the buffer being filled, those queued to be written oldest first, and those free
+   u32 filling = 0;
+   std::deque<u32> queued;
+   std::vector<u32> free;
+   // bytes of the oldest queued buffer written, and whether a write of it is in flight
+   u32 written = 0;
+   bool writing = false, broken = false;
+
+   out_buf_t() {
+      for (u32 i = 0; i < io::out_buffers; i++) {
+         buffers[i].resize(io::chunk);
+         sizes[i] = 0;
+         if (i != 0) {
+            free.push_back(i);
+         }
+      }
+   }
+
+   // moves the queue along as far as it goes without waiting
+   void pump() {
+      while (!queued.empty()) {
+         u32 front = queued.front();
+         if (writing) {
+            if (!complete(output, false)) {
+               return;
+            }
+            writing = false;
+            i64 res = ops[output].result;
+            if (res < 0 && res != -EINTR && res != -EAGAIN) {
+               // nowhere for output to go, it is dropped
+               broken = true;
+            } else if (res > 0) {
+               written += res;
+               io::stats.bytesOut += res;
+            }
+         }
+         if (broken || written == sizes[front]) {
+            free.push_back(front);
+            queued.pop_front();
+            written = 0;
+            continue;
+         }
+         submit(output, buffers[front].data() + written, sizes[front] - written);
+         writing = true;
+      }
+   }
+
+   // queues the buffer being filled and starts filling a free one, waiting for one when there is none
+   void hand_over() {
+      if (sizes[filling] == 0) {
+         pump();
+         return;
+      }
+      queued.push_back(filling);
+      pump();
+      if (free.empty()) {
+         u64 started = timing::wall_ns();
+         while (free.empty()) {
+            complete(output, true);
+            pump();
+         }
+         io::stats.outputWait += timing::wall_ns() - started;
+      }
+      filling = free.back();
+      free.pop_back();
+      sizes[filling] = 0;
+   }
+
+   void drain() {
+      hand_over();
+      u64 started = timing::wall_ns();
+      while (!queued.empty()) {
+         complete(output, true);
+         pump();
+      }
+      io::stats.outputWait += timing::wall_ns() - started;
+   }
+
+   // there is no put area, so every write comes through here and can take the lock
+   std::streamsize xsputn(const char* s, std::streamsize n) override {
+      std::lock_guard<std::mutex> guard(lock);
+      for (std::streamsize left = n; left > 0;) {
+         if (sizes[filling] == io::chunk) {
+            hand_over();
+         }
+         u32 take = std::min<std::streamsize>(left, io::chunk - sizes[filling]);
+         memcpy(buffers[filling].data() + sizes[filling], s, take);
+         sizes[filling] += take;
+         s += take;
+         left -= take;
+      }
+      return n;
+   }
+
+   int_type overflow(int_type c) override {
+      if (traits_type::eq_int_type(c, traits_type::eof())) {
+         return traits_type::not_eof(c);
+      }
+      char ch = traits_type::to_char_type(c);
+      xsputn(&ch, 1);
+      return c;
+   }
+
+   int sync() override {
+      std::lock_guard<std::mutex> guard(lock);
+      hand_over();
+      return 0;
+   }
+};
+
+struct in_buf_t : std::streambuf {
+   std::vector<char> buffers[2];
+   // the buffer read into next, the program using the other
+   u32 reading = 0;
+   bool eof = false;
+   mutptr(out_buf_t) out;
+
+   explicit in_buf_t(mutptr(out_buf_t) out) : out(out) {
+      buffers[0].resize(io::chunk);
+      buffers[1].resize(io::chunk);
+   }
+
+   int_type underflow() override {
+      if (gptr() < egptr()) {
+         return traits_type::to_int_type(*gptr());
+      }
+      if (eof) {
+         return traits_type::eof();
+      }
+      std::lock_guard<std::mutex> guard(lock);
+      i64 got;
+      while (true) {
+         if (!ops[input].pending && !(io::backend == io::uring && ops[input].result != 0)) {
+            submit(input, buffers[reading].data(), io::chunk);
+         }
+         if (!complete(input, false)) {
+            out->hand_over();
+            u64 started = timing::wall_ns();
+            complete(input, true);
+            io::stats.inputWait += timing::wall_ns() - started;
+         }
+         got = ops[input].result;
+         ops[input].result = 0;
+         if (got != -EINTR && got != -EAGAIN) {
+            break;
+         }
+      }
+      if (got <= 0) {
+         eof = true;
+         return traits_type::eof();
+      }
+      io::stats.bytesIn += got;
+      mutptr(char) data = buffers[reading].data();
+      reading ^= 1;
+      if (io::backend == io::uring) {
+         // the next chunk is on its way while the program uses this one
+         submit(input, buffers[reading].data(), io::chunk);
+      }
+      setg(data, data, data + got);
+      return traits_type::to_int_type(*gptr());
+   }
+};
+
+static mutptr(out_buf_t) outBuf = nullptr;
+static mutptr(in_buf_t) inBuf = nullptr;
+static std::streambuf* oldIn;
+static std::streambuf* oldOut;
+static std::ostream* oldTie;
+
+io::backend_e io::start(backend_e wanted) {
+   if (wanted == off || outBuf != nullptr) {
+      return backend;
+   }
+   backend = blocking;
+#ifdef STACK_IO_URING
+   if (wanted == uring && ring_setup()) {
+      backend = uring;
+   }
+#endif
+   ops[input] = ops[output] = op_t { false, 0 };
+   std::cout.flush();
+   outBuf = new out_buf_t();
+   inBuf = new in_buf_t(outBuf);
+   oldIn = std::cin.rdbuf(inBuf);
+   oldOut = std::cout.rdbuf(outBuf);
+   oldTie = std::cin.tie(nullptr);
+   return backend;
+}
+
+void io::stop() {
+   if (outBuf == nullptr) {
+      return;
+   }
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      outBuf->drain();
+   }
+   std::cin.rdbuf(oldIn);
+   std::cout.rdbuf(oldOut);
+   std::cin.tie(oldTie);
+#ifdef STACK_IO_URING
+   if (backend == uring) {
+      ring_close();
+   }
+#endif
+   delete inBuf;
+   delete outBuf;
+   inBuf = nullptr;
+   outBuf = nullptr;
+}
+
+std::string io::to_string(backend_e in) {
+   switch (in) {
+      case uring:
+         return "io_uring";
+      case blocking:
+         return "read/write";
+      default:
+         return "iostream";
+   }
+}
+
+void io::report(mutref(std::ostream) out) {
+   out << "io: " << to_string(backend) << ", " << stats.bytesIn << " bytes in over " << stats.reads << " reads, "
+       << stats.bytesOut << " bytes out over " << stats.writes << " writes, waited "
+       << stats.inputWait / 1000 << "us for input and " << stats.outputWait / 1000 << "us for output\n";
+}
@@ -0,0 +1,1106 @@
+//
+// Control-flow graph and SSA form over the statements produced by interpreter::reset, and the passes
+// that rewrite interpreter::statements from them.
+//
+// blocks end at jumps, beginf and endf and start at anything those can reach. endf can return to any
+// statement after a jump, so it gets an edge to every one of them. the top of each a-z stack is an SSA
+// variable: every statement writing, pushing or popping a stack defines a new value of it, and phis are
+// placed on the dominance frontiers of those. popping a value pushed earlier in the same block gives
+// back the value under it, anything else popped is unknown.
+//
+// values are numbered as they are defined, operations on equal numbers getting equal numbers, which
+// gvn and licm use to find recomputations, and literals keep theirs so fold can put them back in place
+// of the stacks holding them. the passes rewrite statements in place (to copies, literals or nops), move
+// them in front of a loop or drop them, remapping jump targets, and the program is built again after.
+//
+
+#include <ir.h>
+#include <alloc.h>
+#include <reduce.h>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+
+using namespace interpreter;
+
+ir::program_t ir::program;
+ir::stats_t ir::stats;
+u32 ir::inline_limit = 16;
+
+typedef std::tuple<u32, u32, u32, u32> expression_t;
+
+static std::map<expression_t, u32> expressions;
+static std::map<std::pair<u32, std::string>, u32> literals;
+// the literal behind each literal's number
+static std::map<u32, node_t> constants;
+static u32 nextVn = 0;
+
+bool ir::is_op(lexer::tok_type_e op) {
+   switch (op) {
+      case lexer::add:
+      case lexer::sub:
+      case lexer::mul:
+      case lexer::div:
+      case lexer::idiv:
+      case lexer::mod:
+      case lexer::eq:
+      case lexer::neq:
+      case lexer::gt:
+      case lexer::lt:
+      case lexer::gte:
+      case lexer::lte:
+      case lexer::and_:
+      case lexer::or_:
+      case lexer::xor_:
+         return true;
+      default:
+         return false;
+   }
+}
+
+static u32 stack_of(ref(node_t) in) {
+   u32 idx = any_cast<u32>(in.data);
+   return idx < 26 ? idx : ir::none;
+}
+
+u32 ir::written(ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (is_op(op)) {
+      if (stmt.size() < 2 || stmt[stmt.size() - 2].type != lexer::stack) {
+         return none;
+      }
+      return stack_of(stmt[stmt.size() - 2]);
+   }
+   switch (op) {
+      case lexer::stack:
+         return stack_of(stmt[stmt.size() - 1]);
+      case lexer::cast:
+         return stmt.size() >= 3 && stmt[1].type == lexer::stack ? stack_of(stmt[1]) : none;
+      case lexer::read:
+         return stmt[0].type == lexer::stack ? stack_of(stmt[0]) : none;
+      case lexer::receive:
+      case lexer::coroutine:
+         return stack_of(stmt[0]);
+      case lexer::resume:
+      case lexer::done:
+         return stack_of(stmt[1]);
+      case lexer::map:
+      case lexer::reduce:
+         return stack_of(stmt[1]);
+      case lexer::push:
+      case lexer::pop:
+         return stack_of(stmt[0]);
+      default:
+         return none;
+   }
+}
+
+std::vector<u32> ir::operands(ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (is_op(op)) {
+      if (stmt.size() < 3) {
+         return { };
+      }
+      if (stmt[0].type == lexer::sub) {
+         return { 1 };
+      }
+      return { 0, 1 };
+   }
+   switch (op) {
+      case lexer::stack:
+      case lexer::cast:
+         return { 0 };
+      case lexer::print: {
+         std::vector<u32> out;
+         for (u32 i = 0; i + 1 < stmt.size(); i++) {
+            out.push_back(i);
+         }
+         return out;
+      }
+      case lexer::jump:
+         return { stmt[0].type == lexer::not_ ? 1u : 0u };
+      case lexer::map:
+      case lexer::reduce:
+      case lexer::send:
+      case lexer::resume:
+      case lexer::yield:
+      case lexer::done:
+         return { 0 };
+      default:
+         return { };
+   }
+}
+
+static bool is_literal(ref(node_t) in) {
+   return in.type == lexer::integer || in.type == lexer::chr || in.type == lexer::fp || in.type == lexer::str;
+}
+
+static data_t literal_data(ref(node_t) in) {
+   switch (in.type) {
+      case lexer::integer:
+         return data_t { data_type_e::integer, in.data };
+      case lexer::fp:
+         return data_t { data_type_e::fp, in.data };
+      case lexer::chr:
+         return data_t { data_type_e::chr, in.data };
+      default:
+         return data_t { data_type_e::str, in.data };
+   }
+}
+
+std::vector<u32> ir::successors(u32 stmt) {
+   u32 size = statements.size();
+   ref(statement_t) it = statements[stmt];
+   switch (it[it.size() - 1].type) {
+      case lexer::jump: {
+         u32 target = std::min(any_cast<u32>(it[it.size() - 1].data), size);
+         bool negated = it[0].type == lexer::not_;
+         if (is_literal(it[negated])) {
+            return { is_true(literal_data(it[negated])) != negated ? target : stmt + 1 };
+         }
+         return { target, stmt + 1 };
+      }
+      case lexer::map:
+      case lexer::spawn:
+      case lexer::coroutine:
+         // the function runs elsewhere, but is only reachable through here
+         return { std::min(any_cast<u32>(it[it.size() - 1].data), size), stmt + 1 };
+      case lexer::beginf:
+         return { std::min(any_cast<u32>(it[0].data), size) };
+      case lexer::endf: {
+         std::vector<u32> out;
+         for (u32 i = 0; i < size; i++) {
+            ref(statement_t) from = statements[i];
+            lexer::tok_type_e op = from[from.size() - 1].type;
+            // a tail call pushes nothing to return to
+            if ((op == lexer::jump && !tail_call(i)) || op == lexer::map || op == lexer::spawn || op == lexer::coroutine) {
+               out.push_back(i + 1);
+            }
+         }
+         return out;
+      }
+      default:
+         return { stmt + 1 };
+   }
+}
+
+static bool ends_block(lexer::tok_type_e op) {
+   return op == lexer::jump || op == lexer::beginf || op == lexer::endf || op == lexer::map || op == lexer::spawn
+         || op == lexer::coroutine;
+}
+
+// the number of a literal's value, equal literals sharing one
+static u32 literal_vn(ref(node_t) in) {
+   std::string bytes;
+   switch (in.type) {
+      case lexer::integer:
+         bytes = std::string((ptr(char)) in.data, sizeof(i64));
+         break;
+      case lexer::fp:
+         bytes = std::string((ptr(char)) in.data, sizeof(f64));
+         break;
+      case lexer::chr:
+         bytes = std::string(1, *(ptr(char)) in.data);
+         break;
+      default:
+         bytes = *(ptr(std::string)) in.data;
+   }
+   auto found = literals.find({ in.type, bytes });
+   if (found != literals.end()) {
+      return found->second;
+   }
+   literals[{ in.type, bytes }] = nextVn;
+   constants[nextVn] = in;
+   return nextVn++;
+}
+
+// the number of what a node evaluates to before a statement, none when it is not a value
+static u32 operand_vn(ref(node_t) in, ref(ir::tops_t) tops) {
+   if (in.type == lexer::stack) {
+      u32 idx = stack_of(in);
+      return idx == ir::none ? ir::none : ir::program.values[tops[idx]].vn;
+   }
+   if (is_literal(in)) {
+      return literal_vn(in);
+   }
+   return ir::none;
+}
+
+static u32 expression_vn(ref(expression_t) key) {
+   if (std::get<2>(key) == ir::none || std::get<3>(key) == ir::none) {
+      return nextVn++;
+   }
+   auto found = expressions.find(key);
+   if (found != expressions.end()) {
+      return found->second;
+   }
+   expressions[key] = nextVn;
+   return nextVn++;
+}
+
+// the number of the value a statement writes, given the values before it
+static u32 defined_vn(ref(statement_t) stmt, ref(ir::tops_t) tops) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (ir::is_op(op)) {
+      bool negated = stmt[0].type == lexer::sub;
+      u32 one = operand_vn(stmt[negated], tops), two = operand_vn(stmt[1], tops);
+      return expression_vn(expression_t { op, negated, one, two });
+   }
+   switch (op) {
+      case lexer::stack: {
+         u32 vn = operand_vn(stmt[0], tops);
+         return vn == ir::none ? nextVn++ : vn;
+      }
+      case lexer::cast:
+         return expression_vn(expression_t { op, any_cast<data_type_e>(stmt[2].data), operand_vn(stmt[0], tops), 0 });
+      default:
+         return nextVn++;
+   }
+}
+
+bool ir::constant(u32 value, mutref(node_t) out) {
+   auto found = constants.find(program.values[value].vn);
+   if (found == constants.end()) {
+      return false;
+   }
+   out = found->second;
+   return true;
+}
+
+static u32 new_value(ir::value_kind_e kind, u32 stack, u32 at, u32 vn) {
+   ir::program.values.push_back(ir::value_t { kind, stack, at, { }, vn });
+   return ir::program.values.size() - 1;
+}
+
+static bool dominates(u32 a, u32 b) {
+   while (b != ir::none) {
+      if (a == b) {
+         return true;
+      }
+      b = ir::program.blocks[b].idom;
+   }
+   return false;
+}
+
+// can a node's value be an array
+static bool array_operand(ref(node_t) in) {
+   if (in.type == lexer::stack) {
+      u32 idx = stack_of(in);
+      return idx == ir::none || ir::program.arrays[idx];
+   }
+   return !is_literal(in);
+}
+
+// which stacks can hold an array: arrays only come from array nodes, and flow through copies, casts and
+// arithmetic, which hands back its first operand when that is an array
+static void find_arrays() {
+   std::fill(std::begin(ir::program.arrays), std::end(ir::program.arrays), false);
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (ref(statement_t) stmt : statements) {
+         lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+         u32 w = ir::written(stmt);
+         if (w == ir::none || ir::program.arrays[w]) {
+            continue;
+         }
+         bool array = false;
+         if (ir::is_op(op)) {
+            bool arithmetic = op == lexer::add || op == lexer::sub || op == lexer::mul || op == lexer::div
+                  || op == lexer::mod;
+            array = arithmetic && stmt.size() >= 3 && (array_operand(stmt[0]) || array_operand(stmt[1]));
+         } else if (op == lexer::cast && any_cast<data_type_e>(stmt[2].data) == data_type_e::array) {
+            array = true;
+         } else if (op == lexer::stack || op == lexer::cast) {
+            array = array_operand(stmt[0]);
+         } else {
+            // whatever is received or yielded could be an array
+            array = op == lexer::map || op == lexer::receive || op == lexer::resume || (op == lexer::reduce && any_cast<reduce::kind_e>(stmt[2].data) == reduce::sort);
+         }
+         if (array) {
+            ir::program.arrays[w] = changed = true;
+         }
+      }
+   }
+}
+
+void ir::build() {
+   program = program_t { };
+   expressions.clear();
+   literals.clear();
+   constants.clear();
+   nextVn = 0;
+   u32 size = statements.size();
+   if (size == 0) {
+      return;
+   }
+
+   // blocks start at the entry, at every target and after every jump, beginf and endf
+   std::vector<bool> leader(size + 1, false);
+   leader[0] = true;
+   for (u32 i = 0; i < size; i++) {
+      ref(statement_t) stmt = statements[i];
+      if (!ends_block(stmt[stmt.size() - 1].type)) {
+         continue;
+      }
+      leader[i + 1] = true;
+      if (stmt[stmt.size() - 1].type != lexer::endf) {
+         leader[successors(i)[0]] = true;
+      }
+   }
+   program.blockOf.assign(size, none);
+   for (u32 i = 0; i < size; i++) {
+      if (leader[i]) {
+         program.blocks.push_back(block_t { i, i, { }, { }, none, false });
+      }
+      program.blocks.back().last = i + 1;
+      program.blockOf[i] = program.blocks.size() - 1;
+   }
+   u32 count = program.blocks.size();
+   for (u32 b = 0; b < count; b++) {
+      mutref(block_t) block = program.blocks[b];
+      for (u32 to : successors(block.last - 1)) {
+         if (to >= size) {
+            continue;
+         }
+         u32 succ = program.blockOf[to];
+         if (std::find(block.succs.begin(), block.succs.end(), succ) == block.succs.end()) {
+            block.succs.push_back(succ);
+            program.blocks[succ].preds.push_back(b);
+         }
+      }
+   }
+
+   // reverse postorder of the reachable blocks
+   std::vector<u32> order, rpoNum(count, none);
+   {
+      std::vector<std::pair<u32, u32>> work { { 0, 0 } };
+      program.blocks[0].reachable = true;
+      while (!work.empty()) {
+         std::pair<u32, u32>& top = work.back();
+         ref(std::vector<u32>) succs = program.blocks[top.first].succs;
+         if (top.second < succs.size()) {
+            u32 next = succs[top.second++];
+            if (!program.blocks[next].reachable) {
+               program.blocks[next].reachable = true;
+               work.push_back({ next, 0 });
+            }
+            continue;
+         }
+         order.push_back(top.first);
+         work.pop_back();
+      }
+      std::reverse(order.begin(), order.end());
+      for (u32 i = 0; i < order.size(); i++) {
+         rpoNum[order[i]] = i;
+      }
+   }
+
+   // dominators, Cooper, Harvey and Kennedy's iterative algorithm
+   std::vector<u32> idom(count, none);
+   idom[0] = 0;
+   auto intersect = [&](u32 a, u32 b) {
+      while (a != b) {
+         while (rpoNum[a] > rpoNum[b]) {
+            a = idom[a];
+         }
+         while (rpoNum[b] > rpoNum[a]) {
+            b = idom[b];
+         }
+      }
+      return a;
+   };
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (u32 i = 1; i < order.size(); i++) {
+         u32 b = order[i], next = none;
+         for (u32 p : program.blocks[b].preds) {
+            if (idom[p] != none) {
+               next = next == none ? p : intersect(p, next);
+            }
+         }
+         if (idom[b] != next) {
+            idom[b] = next;
+            changed = true;
+         }
+      }
+   }
+   for (u32 b = 1; b < count; b++) {
+      program.blocks[b].idom = idom[b];
+   }
+
+   // dominance frontiers, then phis for every stack written in a block on them
+   std::vector<std::vector<u32>> frontier(count);
+   for (u32 b : order) {
+      ref(block_t) block = program.blocks[b];
+      if (block.preds.size() < 2) {
+         continue;
+      }
+      for (u32 p : block.preds) {
+         if (!program.blocks[p].reachable) {
+            continue;
+         }
+         for (u32 runner = p; runner != idom[b]; runner = idom[runner]) {
+            if (std::find(frontier[runner].begin(), frontier[runner].end(), b) == frontier[runner].end()) {
+               frontier[runner].push_back(b);
+            }
+            if (runner == 0) {
+               break;
+            }
+         }
+      }
+   }
+   program.phis.assign(count, { });
+   for (u32 s = 0; s < 26; s++) {
+      std::vector<bool> placed(count, false), queued(count, false);
+      std::vector<u32> work;
+      for (u32 b : order) {
+         ref(block_t) block = program.blocks[b];
+         for (u32 i = block.first; i < block.last; i++) {
+            if (written(statements[i]) == s) {
+               work.push_back(b);
+               queued[b] = true;
+               break;
+            }
+         }
+      }
+      while (!work.empty()) {
+         u32 b = work.back();
+         work.pop_back();
+         for (u32 f : frontier[b]) {
+            if (placed[f]) {
+               continue;
+            }
+            placed[f] = true;
+            u32 id = new_value(phi, s, f, nextVn++);
+            program.values[id].args.assign(program.blocks[f].preds.size(), none);
+            program.phis[f].push_back(id);
+            if (!queued[f]) {
+               queued[f] = true;
+               work.push_back(f);
+            }
+         }
+      }
+   }
+
+   // renaming in reverse postorder, every block starting from where its immediate dominator ended
+   find_arrays();
+   program.tops.assign(size, tops_t { });
+   program.defs.assign(size, none);
+   std::vector<tops_t> exits(count);
+   tops_t entry { };
+   for (u32 s = 0; s < 26; s++) {
+      entry[s] = new_value(unknown, s, 0, nextVn++);
+   }
+   auto rename = [&](u32 b, tops_t cur) {
+      ref(block_t) block = program.blocks[b];
+      for (u32 id : program.phis[b]) {
+         cur[program.values[id].stack] = id;
+      }
+      std::array<std::vector<u32>, 26> below;
+      for (u32 i = block.first; i < block.last; i++) {
+         ref(statement_t) stmt = statements[i];
+         program.tops[i] = cur;
+         u32 w = written(stmt);
+         if (w == none) {
+            continue;
+         }
+         lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+         u32 vn;
+         if (op == lexer::pop && !below[w].empty()) {
+            vn = program.values[below[w].back()].vn;
+            below[w].pop_back();
+         } else {
+            if (op == lexer::push) {
+               below[w].push_back(cur[w]);
+            }
+            vn = defined_vn(stmt, cur);
+         }
+         program.defs[i] = new_value(defined, w, i, vn);
+         cur[w] = program.defs[i];
+      }
+      exits[b] = cur;
+   };
+   for (u32 b : order) {
+      rename(b, b == 0 ? entry : exits[idom[b]]);
+   }
+   for (u32 b : order) {
+      ref(block_t) block = program.blocks[b];
+      for (u32 succ : block.succs) {
+         ref(std::vector<u32>) preds = program.blocks[succ].preds;
+         u32 k = std::find(preds.begin(), preds.end(), b) - preds.begin();
+         for (u32 id : program.phis[succ]) {
+            program.values[id].args[k] = exits[b][program.values[id].stack];
+         }
+      }
+   }
+   // unreachable code knows nothing about the stacks
+   for (u32 b = 0; b < count; b++) {
+      if (program.blocks[b].reachable) {
+         continue;
+      }
+      tops_t unknowns { };
+      for (u32 s = 0; s < 26; s++) {
+         unknowns[s] = new_value(unknown, s, b, nextVn++);
+      }
+      rename(b, unknowns);
+   }
+}
+
+// can an operation be replaced by a copy of its result, or run fewer times than it used to. arithmetic
+// appends to its first operand when that is an array, so it has to be one that never is
+static bool pure(ref(statement_t) stmt) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   switch (op) {
+      case lexer::add:
+      case lexer::sub:
+      case lexer::mul:
+      case lexer::div:
+      case lexer::idiv:
+      case lexer::mod:
+         return stmt[0].type != lexer::sub && !array_operand(stmt[0]);
+      case lexer::cast:
+         // every cast to an array makes a new one
+         return any_cast<data_type_e>(stmt[2].data) != data_type_e::array;
+      case lexer::stack:
+         return true;
+      default:
+         return ir::is_op(op) && stmt[0].type != lexer::sub;
+   }
+}
+
+static statement_t nop_statement() {
+   return statement_t { node_t { lexer::nop, nullptr } };
+}
+
+u32 ir::gvn() {
+   u32 replaced = 0;
+   for (ref(block_t) block : program.blocks) {
+      if (!block.reachable) {
+         continue;
+      }
+      for (u32 i = block.first; i < block.last; i++) {
+         mutref(statement_t) stmt = statements[i];
+         if (!is_op(stmt[stmt.size() - 1].type) || !pure(stmt) || program.defs[i] == none) {
+            continue;
+         }
+         u32 vn = program.values[program.defs[i]].vn, dest = written(stmt);
+         ref(tops_t) tops = program.tops[i];
+         if (program.values[tops[dest]].vn == vn) {
+            // the stack already holds the result
+            stmt = nop_statement();
+            replaced++;
+            continue;
+         }
+         for (u32 s = 0; s < 26; s++) {
+            if (program.values[tops[s]].vn == vn) {
+               stmt = statement_t {
+                     node_t { lexer::stack, alloc::make<u32>(alloc::program, s) },
+                     node_t { lexer::stack, stmt[stmt.size() - 2].data }
+               };
+               replaced++;
+               break;
+            }
+         }
+      }
+   }
+   return replaced;
+}
+
+// lays the statements out again, the copies of the statements in before[i] going in front of statement i
+// and dropped statements disappearing. jumps and beginf aimed at statement i land on the first of its
+// before statements, unless skip(from, i), and on whatever follows a dropped statement
+static void relayout(ref(std::vector<std::vector<u32>>) before, ref(std::vector<bool>) dropped,
+                     const std::function<bool(u32, u32)>& skip) {
+   u32 size = statements.size();
+   std::vector<u32> newIndex(size + 1), preIndex(size + 1, ir::none);
+   std::vector<statement_t> out;
+   std::vector<lexer::file_pos_t> outPositions;
+   bool positioned = positions.size() == size;
+   for (u32 i = 0; i < size; i++) {
+      if (!before[i].empty()) {
+         preIndex[i] = out.size();
+         for (u32 from : before[i]) {
+            out.push_back(statements[from]);
+            if (positioned) {
+               outPositions.push_back(positions[from]);
+            }
+         }
+      }
+      newIndex[i] = out.size();
+      if (dropped[i]) {
+         continue;
+      }
+      out.push_back(statements[i]);
+      if (positioned) {
+         outPositions.push_back(positions[i]);
+      }
+   }
+   newIndex[size] = out.size();
+   for (u32 i = 0; i < size; i++) {
+      ref(statement_t) stmt = statements[i];
+      lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      if (dropped[i] || (op != lexer::jump && op != lexer::beginf && op != lexer::map && op != lexer::spawn
+                         && op != lexer::coroutine)) {
+         continue;
+      }
+      ref(node_t) node = op == lexer::beginf ? stmt[0] : stmt[stmt.size() - 1];
+      u32 target = std::min(any_cast<u32>(node.data), size);
+      *(u32*) node.data = preIndex[target] != ir::none && !skip(i, target) ? preIndex[target] : newIndex[target];
+   }
+   statements = out;
+   if (positioned) {
+      positions = outPositions;
+   }
+}
+
+// the body [first, endf) of the function a jump calls, false when it does not call one or the body could
+// leave by anything but its endf
+static bool body_of(ref(statement_t) call, mutref(u32) first, mutref(u32) endf) {
+   u32 size = statements.size();
+   first = any_cast<u32>(call[call.size() - 1].data);
+   if (first == 0 || first > size) {
+      return false;
+   }
+   ref(statement_t) begin = statements[first - 1];
+   if (begin[begin.size() - 1].type != lexer::beginf || any_cast<u32>(begin[0].data) > size) {
+      return false;
+   }
+   endf = any_cast<u32>(begin[0].data) - 1;
+   if (endf < first || statements[endf][statements[endf].size() - 1].type != lexer::endf) {
+      return false;
+   }
+   for (u32 i = first; i < endf; i++) {
+      if (ends_block(statements[i][statements[i].size() - 1].type)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+u32 ir::inline_calls() {
+   u32 size = statements.size(), count = 0;
+   std::vector<std::vector<u32>> before(size);
+   std::vector<bool> dropped(size, false);
+   for (u32 i = 0; i < size; i++) {
+      ref(statement_t) stmt = statements[i];
+      if (stmt[stmt.size() - 1].type != lexer::jump || stmt[0].type == lexer::not_ || !is_literal(stmt[0])
+            || !is_true(literal_data(stmt[0]))) {
+         continue;
+      }
+      u32 first, endf;
+      if (!body_of(stmt, first, endf) || endf - first > inline_limit) {
+         continue;
+      }
+      for (u32 j = first; j < endf; j++) {
+         before[i].push_back(j);
+      }
+      dropped[i] = true;
+      count++;
+   }
+   if (count != 0) {
+      relayout(before, dropped, [](u32, u32) { return false; });
+   }
+   return count;
+}
+
+u32 ir::licm() {
+   u32 count = program.blocks.size(), size = statements.size();
+   // natural loops by header, merging back edges to the same header
+   std::map<u32, std::vector<bool>> loops;
+   for (u32 b = 0; b < count; b++) {
+      if (!program.blocks[b].reachable) {
+         continue;
+      }
+      for (u32 h : program.blocks[b].succs) {
+         if (!dominates(h, b)) {
+            continue;
+         }
+         mutref(std::vector<bool>) body = loops[h];
+         body.resize(count, false);
+         body[h] = true;
+         std::vector<u32> work;
+         if (!body[b]) {
+            body[b] = true;
+            work.push_back(b);
+         }
+         while (!work.empty()) {
+            u32 at = work.back();
+            work.pop_back();
+            for (u32 p : program.blocks[at].preds) {
+               if (!body[p] && program.blocks[p].reachable) {
+                  body[p] = true;
+                  work.push_back(p);
+               }
+            }
+         }
+      }
+   }
+
+   // statements to hoist in front of each header
+   std::map<u32, std::vector<u32>> hoists;
+   std::vector<bool> hoisted(size, false);
+   u32 moved = 0;
+   for (ref(auto) loop : loops) {
+      ref(block_t) header = program.blocks[loop.first];
+      u32 writes[26] { };
+      bool valid = true;
+      for (u32 b = 0; b < count; b++) {
+         if (!loop.second[b]) {
+            continue;
+         }
+         valid = valid && dominates(loop.first, b);
+         for (u32 i = program.blocks[b].first; i < program.blocks[b].last; i++) {
+            u32 w = written(statements[i]);
+            if (w != none) {
+               writes[w]++;
+            }
+         }
+      }
+      if (!valid) {
+         continue;
+      }
+      bool read[26] { };
+      for (u32 i = header.first; i < header.last; i++) {
+         ref(statement_t) stmt = statements[i];
+         lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+         if (op == lexer::print || op == lexer::read) {
+            break;
+         }
+         u32 w = written(stmt);
+         bool invariant = (is_op(op) || op == lexer::cast || op == lexer::stack) && pure(stmt) && w != none
+               && writes[w] == 1 && !read[w];
+         for (u32 idx : operands(stmt)) {
+            ref(node_t) node = stmt[idx];
+            if (node.type == lexer::stack) {
+               u32 s = stack_of(node);
+               invariant = invariant && s != none && writes[s] == 0;
+               read[s == none ? 0 : s] = true;
+            } else {
+               invariant = invariant && is_literal(node);
+            }
+         }
+         if (invariant) {
+            hoists[header.first].push_back(i);
+            hoisted[i] = true;
+            moved++;
+         }
+      }
+   }
+   if (moved == 0) {
+      return 0;
+   }
+
+   std::vector<std::vector<u32>> before(size);
+   for (ref(auto) it : hoists) {
+      before[it.first] = it.second;
+   }
+   // jumps from inside a loop to its header skip what was hoisted, everything else entering it runs them
+   relayout(before, hoisted, [&](u32 from, u32 target) {
+      u32 header = program.blockOf[target];
+      return loops.count(header) && loops[header][program.blockOf[from]];
+   });
+   return moved;
+}
+
+// would compute fold on these literals quietly and without trapping: comparing different types prints
+// them, integer division by zero traps, and repeating a string is only cheap a few times
+static bool foldable(lexer::tok_type_e op, ref(data_t) one, ref(data_t) two) {
+   data_type_e dominant = std::max(one.type, two.type);
+   switch (op) {
+      case lexer::eq:
+      case lexer::neq:
+         return one.type == two.type;
+      case lexer::gt:
+      case lexer::lt:
+      case lexer::gte:
+      case lexer::lte:
+         // these leave an empty value, which no literal can stand for
+         return false;
+      case lexer::mul:
+         return dominant != data_type_e::str
+               || (two.type == data_type_e::integer && any_cast<i64>(two.data) >= 0 && any_cast<i64>(two.data) <= 64);
+      case lexer::idiv:
+         dominant = data_type_e::integer;
+         // fall through
+      case lexer::div:
+      case lexer::mod: {
+         if (dominant == data_type_e::fp || dominant == data_type_e::str) {
+            return true;
+         }
+         runtime_res_t divisor = convert_to(two, dominant);
+         return divisor.second.empty() && is_true(divisor.first);
+      }
+      default:
+         return true;
+   }
+}
+
+// a literal node standing for a computed value, false for values no literal can hold
+static bool literal_of(ref(data_t) in, mutref(node_t) out) {
+   switch (in.type) {
+      case data_type_e::integer:
+         out = node_t { lexer::integer, in.data };
+         return true;
+      case data_type_e::fp:
+         out = node_t { lexer::fp, in.data };
+         return true;
+      case data_type_e::chr:
+         out = node_t { lexer::chr, in.data };
+         return in.data != nullptr;
+      case data_type_e::str:
+         out = node_t { lexer::str, in.data };
+         return true;
+      default:
+         return false;
+   }
+}
+
+u32 ir::fold() {
+   u32 changed = 0;
+   for (ref(block_t) block : program.blocks) {
+      if (!block.reachable) {
+         continue;
+      }
+      for (u32 i = block.first; i < block.last; i++) {
+         mutref(statement_t) stmt = statements[i];
+         lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+         for (u32 idx : operands(stmt)) {
+            node_t literal { };
+            // the destination of a two-operand operation is also its second operand
+            bool dest = is_op(op) && idx == stmt.size() - 2;
+            if (!dest && stmt[idx].type == lexer::stack && stack_of(stmt[idx]) != none
+                  && constant(program.tops[i][stack_of(stmt[idx])], literal)) {
+               stmt[idx] = literal;
+               stats.propagated++;
+               changed++;
+            }
+         }
+
+         u32 w = written(stmt);
+         node_t result { };
+         if (is_op(op) && w != none && stmt.size() >= 4 && is_literal(stmt[0]) && is_literal(stmt[1])) {
+            data_t one = literal_data(stmt[0]), two = literal_data(stmt[1]);
+            if (!foldable(op, one, two)) {
+               continue;
+            }
+            runtime_res_t res = compute(op, one, two);
+            if (!res.second.empty() || !literal_of(res.first, result)) {
+               continue;
+            }
+            stmt = statement_t { result, stmt[stmt.size() - 2] };
+         } else if (op == lexer::cast && w != none && is_literal(stmt[0])) {
+            runtime_res_t res = convert_to(literal_data(stmt[0]), any_cast<data_type_e>(stmt[2].data));
+            if (!res.second.empty() || !literal_of(res.first, result)) {
+               continue;
+            }
+            stmt = statement_t { result, stmt[1] };
+         } else {
+            continue;
+         }
+         stats.folded++;
+         changed++;
+      }
+   }
+   return changed;
+}
+
+// holds a stack something for sure, rather than being whatever a pop or an unknown predecessor left
+static bool filled(u32 value) {
+   ref(ir::value_t) it = ir::program.values[value];
+   if (it.kind != ir::defined) {
+      return false;
+   }
+   ref(statement_t) stmt = statements[it.at];
+   return stmt[stmt.size() - 1].type != lexer::pop;
+}
+
+u32 ir::eliminate() {
+   u32 size = statements.size(), removed = 0;
+   // a value is live when a statement reads it, a push buries it for a pop to uncover, or a live phi
+   // can be it
+   std::vector<bool> live(program.values.size(), false);
+   for (ref(block_t) block : program.blocks) {
+      for (u32 i = block.first; block.reachable && i < block.last; i++) {
+         ref(statement_t) stmt = statements[i];
+         for (u32 idx : operands(stmt)) {
+            if (stmt[idx].type == lexer::stack && stack_of(stmt[idx]) != none) {
+               live[program.tops[i][stack_of(stmt[idx])]] = true;
+            }
+         }
+         if (stmt[stmt.size() - 1].type == lexer::push && written(stmt) != none) {
+            live[program.tops[i][written(stmt)]] = true;
+         }
+      }
+   }
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (ref(std::vector<u32>) phis : program.phis) {
+         for (u32 id : phis) {
+            if (!live[id]) {
+               continue;
+            }
+            for (u32 arg : program.values[id].args) {
+               if (arg != none && !live[arg]) {
+                  live[arg] = changed = true;
+               }
+            }
+         }
+      }
+   }
+
+   // copies nobody reads, which cannot fail because both stacks are known to hold something
+   for (ref(block_t) block : program.blocks) {
+      for (u32 i = block.first; block.reachable && i < block.last; i++) {
+         mutref(statement_t) stmt = statements[i];
+         if (stmt[stmt.size() - 1].type != lexer::stack || program.defs[i] == none || live[program.defs[i]]) {
+            continue;
+         }
+         bool safe = filled(program.tops[i][written(stmt)]);
+         if (stmt[0].type == lexer::stack) {
+            safe = safe && stack_of(stmt[0]) != none && filled(program.tops[i][stack_of(stmt[0])]);
+         } else {
+            safe = safe && is_literal(stmt[0]);
+         }
+         if (safe) {
+            stmt = nop_statement();
+            stats.eliminated++;
+            removed++;
+         }
+      }
+   }
+
+   std::vector<bool> dropped(size, false);
+   for (u32 i = 0; i < size; i++) {
+      lexer::tok_type_e op = statements[i][statements[i].size() - 1].type;
+      // an endf nothing reaches is kept, as whether the jump before it is a tail call depends on it
+      if (!program.blocks[program.blockOf[i]].reachable && op != lexer::endf) {
+         dropped[i] = true;
+         stats.unreachable++;
+         removed++;
+      } else if (op == lexer::jump) {
+         // a jump that is never taken does nothing
+         ref(statement_t) stmt = statements[i];
+         bool negated = stmt[0].type == lexer::not_;
+         dropped[i] = is_literal(stmt[negated]) && is_true(literal_data(stmt[negated])) == negated;
+      } else {
+         dropped[i] = op == lexer::nop || op == lexer::label;
+      }
+   }
+   relayout(std::vector<std::vector<u32>>(size), dropped, [](u32, u32) { return false; });
+   return removed;
+}
+
+void ir::optimise() {
+   stats = stats_t { };
+   // what was proven about the statements no longer holds once they change
+   proven.clear();
+   if (inline_limit != 0) {
+      stats.inlined = inline_calls();
+   }
+   // every round of folding can make more stack tops known literals
+   for (u32 round = 0; round < 16; round++) {
+      build();
+      if (fold() == 0) {
+         break;
+      }
+   }
+   build();
+   stats.numbered = gvn();
+   stats.hoisted = licm();
+   build();
+   for (u32 round = 0; round < 16; round++) {
+      u32 removed = eliminate();
+      build();
+      if (removed == 0) {
+         break;
+      }
+   }
+}
+
+static std::string text(ref(node_t) in) {
+   switch (in.type) {
+      case lexer::stack:
+      case lexer::push:
+      case lexer::pop: {
+         std::string name(1, (char) ('a' + any_cast<u32>(in.data)));
+         return in.type == lexer::push ? ">" + name : in.type == lexer::pop ? "<" + name : name;
+      }
+      case lexer::integer:
+         return std::to_string(any_cast<i64>(in.data));
+      case lexer::fp:
+         return std::to_string(any_cast<f64>(in.data));
+      case lexer::chr:
+         return "'" + std::string(1, any_cast<char>(in.data)) + "'";
+      case lexer::str:
+         return "\"" + replace_all(any_cast<std::string>(in.data), "\n", "\\n") + "\"";
+      case lexer::jump:
+         return "^" + std::to_string(any_cast<u32>(in.data));
+      case lexer::map:
+         return "@" + std::to_string(any_cast<u32>(in.data));
+      case lexer::spawn:
+         return "~" + std::to_string(any_cast<u32>(in.data));
+      case lexer::coroutine:
+         return ":" + std::to_string(any_cast<u32>(in.data));
+      case lexer::send:
+         return "}" + std::string(1, (char) ('a' + any_cast<u32>(in.data)));
+      case lexer::receive:
+         return "{" + std::string(1, (char) ('a' + any_cast<u32>(in.data)));
+      default:
+         return lexer::to_string(in.type);
+   }
+}
+
+static std::string name(u32 value) {
+   ref(ir::value_t) it = ir::program.values[value];
+   return std::string(1, (char) ('a' + it.stack)) + std::to_string(value);
+}
+
+void ir::dump(mutref(std::ostream) out) {
+   out << "ir: " << program.blocks.size() << " blocks, " << program.values.size() << " values, " << stats.inlined
+       << " calls inlined, " << stats.propagated << " operands propagated, " << stats.folded << " statements folded, "
+       << stats.numbered << " numbered away, " << stats.hoisted << " hoisted, " << stats.eliminated << " dead and "
+       << stats.unreachable << " unreachable statements removed\n";
+   for (u32 b = 0; b < program.blocks.size(); b++) {
+      ref(block_t) block = program.blocks[b];
+      out << "block " << b << " [" << block.first << ", " << block.last << ")";
+      if (!block.reachable) {
+         out << " unreachable";
+      } else if (block.idom != none) {
+         out << " idom " << block.idom;
+      }
+      out << " ->";
+      for (u32 succ : block.succs) {
+         out << ' ' << succ;
+      }
+      out << '\n';
+      for (u32 id : program.phis[b]) {
+         out << "   " << name(id) << " = phi(";
+         ref(std::vector<u32>) args = program.values[id].args;
+         for (u32 k = 0; k < args.size(); k++) {
+            out << (k ? ", " : "") << (args[k] == none ? "-" : name(args[k]));
+         }
+         out << ")  #" << program.values[id].vn << '\n';
+      }
+      for (u32 i = block.first; i < block.last; i++) {
+         ref(statement_t) stmt = statements[i];
+         out << std::string(3, ' ') << i << ':';
+         for (ref(node_t) node : stmt) {
+            out << ' ' << text(node);
+         }
+         std::vector<u32> reads = operands(stmt);
+         if (!reads.empty() || program.defs[i] != none) {
+            out << "   ;";
+         }
+         for (u32 idx : reads) {
+            if (stmt[idx].type == lexer::stack && stack_of(stmt[idx]) != none) {
+               out << ' ' << name(program.tops[i][stack_of(stmt[idx])]);
+            }
+         }
+         if (program.defs[i] != none) {
+            out << " -> " << name(program.defs[i]) << " #" << program.values[program.defs[i]].vn;
+         }
+         out << '\n';
+      }
+   }
+}
@@ -0,0 +1,424 @@
+//
+// Baseline template JIT, translates interpreter::statements into x86-64 machine code.
+//
+// every statement becomes a fixed template: operands are decoded at compile time and baked in as
+// immediates, values are handled by calls into the interpreter's exec_* helpers, and control flow
+// (jumps, beginf, endf) becomes native branches between the statements' code.
+//
+
+#include <jit.h>
+#include <alloc.h>
+#include <parallel.h>
+#include <reduce.h>
+#include <channel.h>
+#include <coroutine.h>
+#include <iostream>
+#include <cstring>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define STACK_JIT_X64
+#endif
+
+using namespace interpreter;
+
+static std::string error;
+static u8* code = nullptr;
+static size_t codeSize = 0;
+// native address of every statement, plus the exit, for endf's indirect jumps
+static std::vector<u8*> addresses;
+
+bool jit::supported() {
+#ifdef STACK_JIT_X64
+   return true;
+#else
+   return false;
+#endif
+}
+
+#ifdef STACK_JIT_X64
+
+// runtime helpers called from the generated code, 0 on success, 1 with error set on failure
+static i32 check(ref(runtime_res_t) res) {
+   if (res.second.empty()) {
+      return 0;
+   }
+   error = res.second;
+   return 1;
+}
+
+template<bool checked>
+static i32 op_helper(ptr(statement_t) stmt) {
+   return check(exec_op<checked>(*stmt));
+}
+
+template<bool checked>
+static i32 print_helper(ptr(statement_t) stmt) {
+   return check(exec_print<checked>(*stmt));
+}
+
+template<bool checked>
+static i32 set_helper(ptr(statement_t) stmt) {
+   return check(exec_set<checked>(*stmt));
+}
+
+template<bool checked>
+static i32 cast_helper(ptr(statement_t) stmt) {
+   return check(exec_cast<checked>(*stmt));
+}
+
+template<bool checked>
+static i32 read_helper(ptr(statement_t) stmt) {
+   return check(exec_read<checked>(*stmt));
+}
+
+static void push_helper(u32 idx) {
+   stacks[idx].push(data_t { });
+}
+
+static void pop_helper(u32 idx) {
+   stacks[idx].pop();
+}
+
+static i32 checked_pop_helper(ptr(statement_t) stmt) {
+   return check(exec_pop(*stmt));
+}
+
+static i32 map_helper(ptr(statement_t) stmt) {
+   return check(parallel::map(*stmt));
+}
+
+static i32 reduce_helper(ptr(statement_t) stmt) {
+   return check(reduce::exec(*stmt));
+}
+
+static i32 send_helper(ptr(statement_t) stmt) {
+   return check(channel::send(*stmt));
+}
+
+static i32 receive_helper(ptr(statement_t) stmt) {
+   return check(channel::receive(*stmt));
+}
+
+static i32 spawn_helper(ptr(statement_t) stmt) {
+   return check(channel::spawn(*stmt));
+}
+
+static i32 coroutine_helper(ptr(statement_t) stmt) {
+   return check(coroutine::create(*stmt));
+}
+
+static i32 resume_helper(ptr(statement_t) stmt) {
+   return check(coroutine::resume(*stmt));
+}
+
+static i32 done_helper(ptr(statement_t) stmt) {
+   return check(coroutine::done(*stmt));
+}
+
+// compiled code is the main program, which cannot yield
+static i32 yield_helper(ptr(statement_t) stmt) {
+   return check(coroutine::yield(*stmt));
+}
+
+// 0 false, 1 true, 2 error
+template<bool checked>
+static i32 cond_helper(ptr(statement_t) stmt) {
+   runtime_res_t res = exec_cond<checked>(*stmt);
+   if (check(res)) {
+      return 2;
+   }
+   return is_true(res.first);
+}
+
+static void call_helper(u32 to) {
+   push_return(to);
+}
+
+// the statement to return to, UINT32_MAX on error
+template<bool checked>
+static u32 return_helper() {
+   u32 to = 0;
+   if (check(pop_return<checked>(to))) {
+      return UINT32_MAX;
+   }
+   return to;
+}
+
+struct assembler_t {
+   std::vector<u8> bytes;
+   // offset of a rel32 and the label it refers to
+   std::vector<std::pair<size_t, u32>> fixups;
+   std::vector<size_t> labels;
+
+   void emit(std::initializer_list<u8> in) {
+      bytes.insert(bytes.end(), in);
+   }
+
+   void imm32(u32 in) {
+      for (u32 i = 0; i < 4; i++) {
+         bytes.push_back((in >> (i * 8)) & 0xff);
+      }
+   }
+
+   void imm64(u64 in) {
+      for (u32 i = 0; i < 8; i++) {
+         bytes.push_back((in >> (i * 8)) & 0xff);
+      }
+   }
+
+   // mov rax, fn; call rax
+   void call(ptr(void) fn) {
+      emit({ 0x48, 0xb8 });
+      imm64((u64) fn);
+      emit({ 0xff, 0xd0 });
+   }
+
+   // mov rdi, arg
+   void arg(ptr(void) in) {
+      emit({ 0x48, 0xbf });
+      imm64((u64) in);
+   }
+
+   // mov edi, arg
+   void arg(u32 in) {
+      emit({ 0xbf });
+      imm32(in);
+   }
+
+   // jmp/jcc rel32 to a label, opcode bytes given
+   void branch(std::initializer_list<u8> opcode, u32 label) {
+      emit(opcode);
+      fixups.push_back({ bytes.size(), label });
+      imm32(0);
+   }
+
+   void resolve() {
+      for (ref(auto) it : fixups) {
+         i32 rel = (i32) ((i64) labels[it.second] - (i64) (it.first + 4));
+         std::memcpy(&bytes[it.first], &rel, 4);
+      }
+   }
+};
+
+// the jump's condition, when it is a literal and known at compile time: 0 false, 1 true, -1 unknown
+static i32 constant_cond(ref(statement_t) stmt) {
+   if (stmt[0].type == lexer::not_) {
+      return -1;
+   }
+   data_t dat;
+   switch (stmt[0].type) {
+      case lexer::integer:
+         dat = data_t { data_type_e::integer, stmt[0].data };
+         break;
+      case lexer::chr:
+         dat = data_t { data_type_e::chr, stmt[0].data };
+         break;
+      case lexer::fp:
+         dat = data_t { data_type_e::fp, stmt[0].data };
+         break;
+      case lexer::str:
+         dat = data_t { data_type_e::str, stmt[0].data };
+         break;
+      default:
+         return -1;
+   }
+   return is_true(dat);
+}
+
+std::string jit::compile() {
+   release();
+   u32 size = statements.size();
+   // size is the exit label, size + 1 the error label
+   const u32 exitLabel = size, errorLabel = size + 1;
+   addresses.assign(size + 1, nullptr);
+
+   assembler_t a;
+   a.labels.assign(size + 2, 0);
+   // push rbx; mov rbx, addresses
+   a.emit({ 0x53, 0x48, 0xbb });
+   a.imm64((u64) addresses.data());
+
+   for (u32 i = 0; i < size; i++) {
+      a.labels[i] = a.bytes.size();
+      ref(statement_t) stmt = statements[i];
+      lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      ptr(void) helper = nullptr;
+      // statements proven never to find their stacks empty call helpers that do not check
+      bool checked = i >= proven.size() || !proven[i];
+      switch (op) {
+         case lexer::add:
+         case lexer::sub:
+         case lexer::mul:
+         case lexer::div:
+         case lexer::idiv:
+         case lexer::mod:
+         case lexer::eq:
+         case lexer::neq:
+         case lexer::gt:
+         case lexer::lt:
+         case lexer::gte:
+         case lexer::lte:
+         case lexer::and_:
+         case lexer::or_:
+         case lexer::xor_:
+            helper = checked ? (ptr(void)) op_helper<true> : (ptr(void)) op_helper<false>;
+            break;
+         case lexer::print:
+            helper = checked ? (ptr(void)) print_helper<true> : (ptr(void)) print_helper<false>;
+            break;
+         case lexer::stack:
+            helper = checked ? (ptr(void)) set_helper<true> : (ptr(void)) set_helper<false>;
+            break;
+         case lexer::cast:
+            helper = checked ? (ptr(void)) cast_helper<true> : (ptr(void)) cast_helper<false>;
+            break;
+         case lexer::read:
+            helper = checked ? (ptr(void)) read_helper<true> : (ptr(void)) read_helper<false>;
+            break;
+         case lexer::map:
+            helper = (ptr(void)) map_helper;
+            break;
+         case lexer::reduce:
+            helper = (ptr(void)) reduce_helper;
+            break;
+         case lexer::send:
+            helper = (ptr(void)) send_helper;
+            break;
+         case lexer::receive:
+            helper = (ptr(void)) receive_helper;
+            break;
+         case lexer::spawn:
+            helper = (ptr(void)) spawn_helper;
+            break;
+         case lexer::coroutine:
+            helper = (ptr(void)) coroutine_helper;
+            break;
+         case lexer::resume:
+            helper = (ptr(void)) resume_helper;
+            break;
+         case lexer::done:
+            helper = (ptr(void)) done_helper;
+            break;
+         case lexer::yield:
+            helper = (ptr(void)) yield_helper;
+            break;
+         case lexer::push:
+            a.arg(any_cast<u32>(stmt[0].data));
+            a.call((ptr(void)) push_helper);
+            break;
+         case lexer::pop:
+            if (checked) {
+               helper = (ptr(void)) checked_pop_helper;
+               break;
+            }
+            a.arg(any_cast<u32>(stmt[0].data));
+            a.call((ptr(void)) pop_helper);
+            break;
+         case lexer::jump: {
+            u32 target = std::min(any_cast<u32>(stmt[stmt.size() - 1].data), size);
+            i32 known = constant_cond(stmt);
+            if (known == 0) {
+               break;
+            }
+            if (known == -1) {
+               a.arg(&stmt);
+               a.call(checked ? (ptr(void)) cond_helper<true> : (ptr(void)) cond_helper<false>);
+               // cmp eax, 1; ja error; jb next
+               a.emit({ 0x83, 0xf8, 0x01 });
+               a.branch({ 0x0f, 0x87 }, errorLabel);
+               a.branch({ 0x0f, 0x82 }, i + 1);
+            }
+            if (!tail_call(i)) {
+               a.arg(i + 1);
+               a.call((ptr(void)) call_helper);
+            }
+            a.branch({ 0xe9 }, target);
+            break;
+         }
+         case lexer::beginf:
+            a.branch({ 0xe9 }, std::min(any_cast<u32>(stmt[0].data), size));
+            break;
+         case lexer::endf:
+            a.call(checked ? (ptr(void)) return_helper<true> : (ptr(void)) return_helper<false>);
+            // mov eax, eax; cmp eax, size; ja error; jmp [rbx + rax * 8]
+            a.emit({ 0x89, 0xc0, 0x3d });
+            a.imm32(size);
+            a.branch({ 0x0f, 0x87 }, errorLabel);
+            a.emit({ 0xff, 0x24, 0xc3 });
+            break;
+         default:
+            break;
+      }
+      if (helper) {
+         // mov rdi, stmt; call helper; test eax, eax; jnz error
+         a.arg(&stmt);
+         a.call(helper);
+         a.emit({ 0x85, 0xc0 });
+         a.branch({ 0x0f, 0x85 }, errorLabel);
+      }
+   }
+   // exit: xor eax, eax; pop rbx; ret
+   a.labels[exitLabel] = a.bytes.size();
+   a.emit({ 0x31, 0xc0, 0x5b, 0xc3 });
+   // error: mov eax, 1; pop rbx; ret
+   a.labels[errorLabel] = a.bytes.size();
+   a.emit({ 0xb8 });
+   a.imm32(1);
+   a.emit({ 0x5b, 0xc3 });
+   a.resolve();
+
+   void* mem = mmap(nullptr, a.bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (mem == MAP_FAILED) {
+      return "jit::compile: could not map memory for the generated code";
+   }
+   std::memcpy(mem, a.bytes.data(), a.bytes.size());
+   if (mprotect(mem, a.bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+      munmap(mem, a.bytes.size());
+      return "jit::compile: could not make the generated code executable";
+   }
+   code = (u8*) mem;
+   codeSize = a.bytes.size();
+   for (u32 i = 0; i <= size; i++) {
+      addresses[i] = code + a.labels[i];
+   }
+   return "";
+}
+
+interpreter::runtime_res_t jit::run() {
+   if (!code) {
+      return { data_t { }, "jit::run: nothing compiled" };
+   }
+   error.clear();
+   ((i32 (*)()) code)();
+   runtime_res_t joined = channel::join(!error.empty());
+   if (!joined.second.empty()) {
+      error = joined.second;
+   }
+   if (alloc::reporting) {
+      std::cout.flush();
+      alloc::report(std::cerr);
+   }
+   return { data_t { }, error };
+}
+
+void jit::release() {
+   if (code) {
+      munmap(code, codeSize);
+      code = nullptr;
+      codeSize = 0;
+   }
+}
+
+#else
+
+std::string jit::compile() {
+   return "jit::compile: no code generator for this platform";
+}
+
+interpreter::runtime_res_t jit::run() {
+   return interpreter::run();
+}
+
+void jit::release() { }
+
+#endif
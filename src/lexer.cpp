@@ -296,6 +296,47 @@ tok_t handle_jmp() {
    return tok_t { .type = tok_type_e::jump, .content = ident.first, .filePos = ident.second };
 }
 
+tok_t handle_map() {
+   advance();
+   std::pair<std::string, file_pos_t> ident = get_id();
+   if (ident.first.empty()) {
+      error = "lexer::handle_map: expected identifier after '@', got (" + std::to_string(cur) + ")";
+      return tok_t {};
+   }
+   return tok_t { .type = tok_type_e::map, .content = ident.first, .filePos = ident.second };
+}
+
+// '}' sends to a channel, '{' receives from one, both named like stacks
+tok_t handle_channel(tok_type_e type) {
+   advance();
+   std::pair<std::string, file_pos_t> ident = get_id();
+   if (!is_stack(ident.first)) {
+      error = "lexer::handle_channel: expected a channel name after '{' or '}', got (" + std::to_string(cur) + ")";
+      return tok_t {};
+   }
+   return tok_t { .type = type, .content = ident.first, .filePos = ident.second };
+}
+
+tok_t handle_spawn() {
+   advance();
+   std::pair<std::string, file_pos_t> ident = get_id();
+   if (ident.first.empty()) {
+      error = "lexer::handle_spawn: expected identifier after '~', got (" + std::to_string(cur) + ")";
+      return tok_t {};
+   }
+   return tok_t { .type = tok_type_e::spawn, .content = ident.first, .filePos = ident.second };
+}
+
+tok_t handle_coroutine() {
+   advance();
+   std::pair<std::string, file_pos_t> ident = get_id();
+   if (ident.first.empty()) {
+      error = "lexer::handle_coroutine: expected identifier after ':', got (" + std::to_string(cur) + ")";
+      return tok_t {};
+   }
+   return tok_t { .type = tok_type_e::coroutine, .content = ident.first, .filePos = ident.second };
+}
+
 tok_t handle_cast() {
    advance();
    std::pair<std::string, file_pos_t> ident = get_id();
@@ -304,6 +345,23 @@ tok_t handle_cast() {
       return tok_t {};
    }
    advance();
+   // the builtins over arrays share the syntax of casts
+   static const char* reductions[] = { "sum", "product", "min", "max", "count", "sort" };
+   for (ptr(char) it : reductions) {
+      if (ident.first == it) {
+         return tok_t { .type = tok_type_e::reduce, .content = ident.first, .filePos = ident.second };
+      }
+   }
+   // and so do the ones driving coroutines
+   if (ident.first == "resume") {
+      return tok_t { .type = tok_type_e::resume, .content = ident.first, .filePos = ident.second };
+   }
+   if (ident.first == "yield") {
+      return tok_t { .type = tok_type_e::yield, .content = ident.first, .filePos = ident.second };
+   }
+   if (ident.first == "done") {
+      return tok_t { .type = tok_type_e::done, .content = ident.first, .filePos = ident.second };
+   }
    return tok_t { .type = tok_type_e::cast, .content = ident.first, .filePos = ident.second };
 }
 
@@ -361,6 +419,26 @@ std::vector<tok_t> lexer::lex() {
             // jmp
             toks.push_back(handle_jmp());
             break;
+         case '@':
+            // parallel map
+            toks.push_back(handle_map());
+            break;
+         case '}':
+            // send
+            toks.push_back(handle_channel(tok_type_e::send));
+            break;
+         case '{':
+            // receive
+            toks.push_back(handle_channel(tok_type_e::receive));
+            break;
+         case '~':
+            // spawn
+            toks.push_back(handle_spawn());
+            break;
+         case ':':
+            // coroutine
+            toks.push_back(handle_coroutine());
+            break;
          case '(':
             // cast
             toks.push_back(handle_cast());
@@ -0,0 +1,307 @@
+//
+// Memoization of pure beginf/endf functions, hooked into interpreter::run_with as a policy.
+//
+// a function is pure when its body only computes on stacks: no print, no read, no labels or nested
+// functions, and its only jumps are calls to pure functions. every stack it pushes is popped again
+// further down the body, never below where the stack was on entry, so the only values it can change
+// are the tops of the stacks it writes. a call is keyed on the tops the function or anything it calls
+// reads before writing them, and its result is the tops they write. the result is cached when the endf
+// popping the call's return address runs, or the one after a tail call to it.
+//
+
+#include <memo.h>
+#include <ir.h>
+#include <map>
+#include <iomanip>
+
+using namespace interpreter;
+
+memo::stats_t memo::stats;
+
+// what a statement of a function body does to a stack, in the order it does it
+struct event_t {
+   enum kind_e { read, write, push, pop, call } kind;
+   u32 target;
+};
+
+struct function_t {
+   u32 begin, endf;
+   std::vector<event_t> events;
+   // stacks whose top on entry the function or the functions it calls read, and whose top they write
+   bool inputs[26], writes[26];
+   bool pure;
+};
+
+// a call being run, its result to be cached once the return stack is shallower than depth
+struct frame_t {
+   u32 function;
+   std::string key;
+   u64 depth;
+};
+
+static std::vector<function_t> functions;
+// the pure function a statement's jump calls, -1 when it calls none
+static std::vector<i32> callTo;
+static std::vector<std::map<std::string, std::vector<data_t>>> cache;
+static std::vector<frame_t> frames;
+
+// the function whose body starts at stmt, -1 when none does
+static i32 function_at(u32 stmt) {
+   for (u32 f = 0; f < functions.size(); f++) {
+      if (functions[f].begin + 1 == stmt) {
+         return f;
+      }
+   }
+   return -1;
+}
+
+// records the events of a function's body, false when it does anything but compute on stacks and call
+static bool scan(mutref(function_t) fn) {
+   i32 depth[26] = { };
+   for (u32 i = fn.begin + 1; i < fn.endf; i++) {
+      ref(statement_t) stmt = statements[i];
+      lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+      for (ref(node_t) node : stmt) {
+         if (node.type == lexer::array) {
+            return false;
+         }
+      }
+      if (op == lexer::push || op == lexer::pop) {
+         u32 s = any_cast<u32>(stmt[0].data);
+         fn.events.push_back(event_t { op == lexer::push ? event_t::push : event_t::pop, s });
+         if ((depth[s] += op == lexer::push ? 1 : -1) < 0) {
+            return false;
+         }
+         continue;
+      }
+      if (op != lexer::jump && op != lexer::stack && op != lexer::cast && !ir::is_op(op)) {
+         return false;
+      }
+      for (u32 idx : ir::operands(stmt)) {
+         if (stmt[idx].type == lexer::stack) {
+            fn.events.push_back(event_t { event_t::read, any_cast<u32>(stmt[idx].data) });
+         }
+      }
+      if (op == lexer::jump) {
+         i32 callee = function_at(any_cast<u32>(stmt[stmt.size() - 1].data));
+         if (callee == -1) {
+            return false;
+         }
+         fn.events.push_back(event_t { event_t::call, (u32) callee });
+         continue;
+      }
+      u32 w = ir::written(stmt);
+      if (w == ir::none) {
+         return false;
+      }
+      fn.events.push_back(event_t { event_t::write, w });
+   }
+   for (i32 it : depth) {
+      if (it != 0) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// replays a function's events against what its callees are known to read and write so far, true when
+// that found more. tops pushed over are the function's own, and a top it wrote before reading is too
+static bool replay(mutref(function_t) fn) {
+   u32 depth[26] = { };
+   bool defined[26] = { }, changed = false;
+   auto input = [&](u32 s) {
+      if (depth[s] == 0 && !defined[s] && !fn.inputs[s]) {
+         fn.inputs[s] = changed = true;
+      }
+   };
+   auto output = [&](u32 s) {
+      if (depth[s] == 0 && !fn.writes[s]) {
+         fn.writes[s] = changed = true;
+      }
+   };
+   for (ref(event_t) it : fn.events) {
+      switch (it.kind) {
+         case event_t::read:
+            input(it.target);
+            break;
+         case event_t::write:
+            output(it.target);
+            defined[it.target] |= depth[it.target] == 0;
+            break;
+         case event_t::push:
+            depth[it.target]++;
+            break;
+         case event_t::pop:
+            depth[it.target]--;
+            break;
+         case event_t::call: {
+            // a call may not be taken, so what it writes still counts as read from the caller's tops
+            ref(function_t) callee = functions[it.target];
+            if (fn.pure && !callee.pure) {
+               fn.pure = false;
+               changed = true;
+            }
+            for (u32 s = 0; s < 26; s++) {
+               if (callee.inputs[s]) {
+                  input(s);
+               }
+               if (callee.writes[s]) {
+                  output(s);
+               }
+            }
+            break;
+         }
+      }
+   }
+   return changed;
+}
+
+void memo::reset() {
+   stats = stats_t { };
+   functions.clear();
+   frames.clear();
+   u32 size = statements.size();
+   for (u32 i = 0; i < size; i++) {
+      ref(statement_t) stmt = statements[i];
+      if (stmt[stmt.size() - 1].type != lexer::beginf) {
+         continue;
+      }
+      u32 endf = any_cast<u32>(stmt[0].data) - 1;
+      if (endf <= i || endf >= size || statements[endf][statements[endf].size() - 1].type != lexer::endf) {
+         continue;
+      }
+      functions.push_back(function_t { i, endf, { }, { }, { }, true });
+   }
+   for (mutref(function_t) fn : functions) {
+      fn.pure = scan(fn);
+   }
+   // a function calling an impure one is not pure. what functions read and write only grows, so
+   // replaying them until nothing changes ends
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (mutref(function_t) fn : functions) {
+         changed |= replay(fn);
+      }
+   }
+
+   callTo.assign(size, -1);
+   for (u32 i = 0; i < size; i++) {
+      ref(statement_t) stmt = statements[i];
+      if (stmt[stmt.size() - 1].type != lexer::jump) {
+         continue;
+      }
+      i32 callee = function_at(any_cast<u32>(stmt[stmt.size() - 1].data));
+      if (callee != -1 && functions[callee].pure) {
+         callTo[i] = callee;
+      }
+   }
+   for (ref(function_t) fn : functions) {
+      stats.pure += fn.pure;
+   }
+   cache.assign(functions.size(), { });
+}
+
+// the bytes of the stack tops a function reads, false when a stack it uses is empty or a top cannot
+// be compared by value
+static bool make_key(ref(function_t) fn, mutref(std::string) out) {
+   for (u32 s = 0; s < 26; s++) {
+      if (fn.writes[s] && stacks[s].empty()) {
+         return false;
+      }
+      if (!fn.inputs[s]) {
+         continue;
+      }
+      if (stacks[s].empty()) {
+         return false;
+      }
+      ref(data_t) top = stacks[s].top();
+      if (top.data == nullptr) {
+         return false;
+      }
+      out.push_back((char) top.type);
+      switch (top.type) {
+         case data_type_e::chr:
+            out.push_back(any_cast<char>(top.data));
+            break;
+         case data_type_e::integer:
+            out.append((ptr(char)) top.data, sizeof(i64));
+            break;
+         case data_type_e::fp:
+            out.append((ptr(char)) top.data, sizeof(f64));
+            break;
+         case data_type_e::str: {
+            ref(std::string) str = *(ptr(std::string)) top.data;
+            u64 length = str.size();
+            out.append((ptr(char)) &length, sizeof(u64));
+            out.append(str);
+            break;
+         }
+         default:
+            return false;
+      }
+   }
+   return true;
+}
+
+bool memo::call(u32 stmt) {
+   if (stmt >= callTo.size() || callTo[stmt] == -1) {
+      return false;
+   }
+   u32 f = callTo[stmt];
+   std::string key;
+   if (!make_key(functions[f], key)) {
+      return false;
+   }
+   auto found = cache[f].find(key);
+   if (found != cache[f].end()) {
+      u32 next = 0;
+      for (u32 s = 0; s < 26; s++) {
+         if (functions[f].writes[s]) {
+            stacks[s].top() = found->second[next++];
+         }
+      }
+      stats.hits++;
+      return true;
+   }
+   stats.misses++;
+   frames.push_back(frame_t { f, key, returns.size() + !tail_call(stmt) });
+   return false;
+}
+
+void memo::returned() {
+   while (!frames.empty() && frames.back().depth > returns.size()) {
+      ref(frame_t) frame = frames.back();
+      ref(function_t) fn = functions[frame.function];
+      std::vector<data_t> result;
+      bool complete = true;
+      for (u32 s = 0; s < 26 && complete; s++) {
+         if (fn.writes[s]) {
+            complete = !stacks[s].empty() && stacks[s].top().type != data_type_e::array;
+            result.push_back(complete ? stacks[s].top() : data_t { });
+         }
+      }
+      if (complete) {
+         cache[frame.function][frame.key] = result;
+         stats.stored++;
+      }
+      frames.pop_back();
+   }
+}
+
+void memo::report(mutref(std::ostream) out) {
+   out << "memo: " << stats.pure << " pure functions, " << stats.hits << " hits, " << stats.misses << " misses, "
+       << stats.stored << " results cached\n";
+   for (u32 f = 0; f < functions.size(); f++) {
+      ref(function_t) fn = functions[f];
+      if (!fn.pure) {
+         continue;
+      }
+      out << "  line " << std::setw(4) << (fn.begin < positions.size() ? positions[fn.begin].sLine : 0) << ": keyed on ";
+      for (u32 s = 0; s < 26; s++) {
+         if (fn.inputs[s]) {
+            out << (char) ('a' + s);
+         }
+      }
+      out << ", " << cache[f].size() << " results\n";
+   }
+}
@@ -0,0 +1,247 @@
+//
+// Work-stealing pool of threads, and the parallel map over arrays running on it.
+//
+// each splits the indices it is given into one contiguous range per thread. a thread takes indices off
+// the front of its own range, and once that is empty steals the back half of another's, both by compare
+// and swap on the range's bounds packed into one word, so no lock is taken while working. each called
+// from work each is already running runs on the calling thread alone.
+//
+// a mapped element runs on a fresh copy of the caller's stacks a-z, so the function can use them freely
+// and the results do not depend on which thread ran what. the values on the stacks are shared rather
+// than copied, arrays included.
+//
+
+#include <parallel.h>
+#include <alloc.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+using namespace interpreter;
+
+u32 parallel::threads = 0;
+parallel::stats_t parallel::stats;
+
+// is this thread running work for each already
+static thread_local bool inside = false;
+
+// elements [begin, end) a thread has left, begin in the low half
+struct alignas(64) range_t {
+   std::atomic<u64> bounds;
+};
+
+static inline u64 pack(u32 begin, u32 end) {
+   return (u64) end << 32 | begin;
+}
+
+// takes the next element off the front of a thread's own range
+static bool take(mutref(range_t) own, mutref(u32) out) {
+   u64 bounds = own.bounds.load(std::memory_order_acquire);
+   while ((u32) bounds < (u32) (bounds >> 32)) {
+      if (own.bounds.compare_exchange_weak(bounds, pack((u32) bounds + 1, bounds >> 32), std::memory_order_acq_rel)) {
+         out = (u32) bounds;
+         return true;
+      }
+   }
+   return false;
+}
+
+// moves the back half of another thread's range to an empty one, rounding up so the last element goes too
+static bool steal(mutref(range_t) from, mutref(range_t) to) {
+   u64 bounds = from.bounds.load(std::memory_order_acquire);
+   while ((u32) bounds < (u32) (bounds >> 32)) {
+      u32 begin = (u32) bounds, end = bounds >> 32, mid = begin + (end - begin) / 2;
+      if (from.bounds.compare_exchange_weak(bounds, pack(begin, mid), std::memory_order_acq_rel)) {
+         to.bounds.store(pack(mid, end), std::memory_order_release);
+         return true;
+      }
+   }
+   return false;
+}
+
+// threads kept waiting for work between maps, so a map does not pay for starting them
+struct pool_t {
+   std::vector<std::thread> workers;
+   std::mutex lock;
+   std::condition_variable wake, done;
+   // held by the map using the pool, a map finding it taken runs on its own thread
+   std::mutex busy;
+   std::function<void(u32)> job;
+   u64 generation = 0;
+   u32 participants = 0, running = 0;
+   bool stopping = false;
+
+   void grow(u32 count) {
+      while (workers.size() < count) {
+         u32 who = workers.size() + 1;
+         workers.emplace_back([this, who]() {
+            u64 seen = 0;
+            std::unique_lock<std::mutex> guard(lock);
+            while (true) {
+               wake.wait(guard, [&]() { return stopping || generation != seen; });
+               if (stopping) {
+                  return;
+               }
+               seen = generation;
+               if (who >= participants) {
+                  continue;
+               }
+               guard.unlock();
+               job(who);
+               guard.lock();
+               if (--running == 0) {
+                  done.notify_one();
+               }
+            }
+         });
+      }
+   }
+
+   // runs work on threads 0 to count - 1, the calling thread being 0, and waits for all of them
+   void run(u32 count, ref(std::function<void(u32)>) work) {
+      grow(count - 1);
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         job = work;
+         participants = count;
+         // the calling thread is counted as running until its own share is done
+         running = count;
+         generation++;
+      }
+      wake.notify_all();
+      work(0);
+      std::unique_lock<std::mutex> guard(lock);
+      if (--running != 0) {
+         done.wait(guard, [&]() { return running == 0; });
+      }
+   }
+
+   ~pool_t() {
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         stopping = true;
+      }
+      wake.notify_all();
+      for (mutref(std::thread) it : workers) {
+         it.join();
+      }
+   }
+};
+
+static pool_t pool;
+
+u32 parallel::width() {
+   return threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallel::each(u32 size, ref(std::function<void(u32, u32)>) work) {
+   u32 count = inside ? 1 : std::min(width(), std::max(size, 1u));
+   std::unique_lock<std::mutex> usingPool(pool.busy, std::defer_lock);
+   if (count > 1 && !usingPool.try_lock()) {
+      count = 1;
+   }
+   std::vector<range_t> ranges(count);
+   for (u32 t = 0; t < count; t++) {
+      ranges[t].bounds.store(pack((u64) size * t / count, (u64) size * (t + 1) / count));
+   }
+   std::atomic<u64> steals(0);
+   // where each thread's allocation counters are, for the caller to take them over
+   std::vector<std::pair<mutptr(alloc::site_stats_t), mutptr(u64)>> counters(count);
+
+   auto share = [&](u32 who) {
+      bool nested = inside;
+      inside = true;
+      u32 idx;
+      while (true) {
+         if (!take(ranges[who], idx)) {
+            bool stolen = false;
+            for (u32 k = 1; k < count && !stolen; k++) {
+               stolen = steal(ranges[(who + k) % count], ranges[who]);
+            }
+            if (!stolen) {
+               break;
+            }
+            steals.fetch_add(1, std::memory_order_relaxed);
+            continue;
+         }
+         work(who, idx);
+      }
+      inside = nested;
+      counters[who] = { alloc::sites, &alloc::live };
+   };
+   if (count == 1) {
+      share(0);
+   } else {
+      pool.run(count, share);
+      for (u32 t = 1; t < count; t++) {
+         alloc::absorb(counters[t].first, *counters[t].second);
+      }
+   }
+   stats.steals += steals.load();
+}
+
+runtime_res_t parallel::map(ref(statement_t) stmt) {
+   u32 src = any_cast<u32>(stmt[0].data), dst = any_cast<u32>(stmt[1].data);
+   u32 entry = any_cast<u32>(stmt[2].data);
+   if (entry == 0 || entry > statements.size()
+         || statements[entry - 1][statements[entry - 1].size() - 1].type != lexer::beginf) {
+      return { empty_data_t, "interpreter::run@map: mapped over something that is not a function" };
+   }
+   if (stacks[src].empty() || stacks[src].top().type != data_type_e::array) {
+      return { empty_data_t, "interpreter::run@map: stack mapped over does not hold an array" };
+   }
+   if (stacks[dst].empty()) {
+      return { empty_data_t, "interpreter::run@map: stack mapped to is empty" };
+   }
+   // copied, as the function can append to the array it is given
+   array_t in = *(ptr(array_t)) stacks[src].top().data;
+   u32 size = in.size();
+   mutptr(array_t) out = alloc::make<array_t>(alloc::arithmetic, size);
+   mutptr(stack_t) caller = stacks;
+   // every thread's private stacks, made when it first maps an element
+   std::vector<std::vector<stack_t>> owns(width());
+   std::atomic<bool> failed(false);
+   std::mutex errorLock;
+   std::string error;
+   u32 errorAt = size;
+
+   each(size, [&](u32 who, u32 idx) {
+      if (failed.load(std::memory_order_relaxed)) {
+         return;
+      }
+      mutref(std::vector<stack_t>) own = owns[who];
+      own.resize(32);
+      for (u32 s = 0; s < 26; s++) {
+         own[s] = caller[s];
+      }
+      own[src].top() = in[idx];
+      mutptr(stack_t) saved = stacks;
+      stacks = own.data();
+      runtime_res_t res = call(entry);
+      stacks = saved;
+      if (res.second.empty() && own[dst].empty()) {
+         res.second = "interpreter::run@map: function left the stack mapped to empty";
+      }
+      if (!res.second.empty()) {
+         std::lock_guard<std::mutex> guard(errorLock);
+         if (idx < errorAt) {
+            error = res.second;
+            errorAt = idx;
+         }
+         failed.store(true, std::memory_order_relaxed);
+         return;
+      }
+      (*out)[idx] = own[dst].top();
+   });
+
+   stats.maps++;
+   stats.elements += size;
+   if (!error.empty()) {
+      return { empty_data_t, error };
+   }
+   stacks[dst].top() = data_t { data_type_e::array, out };
+   return { empty_data_t, "" };
+}
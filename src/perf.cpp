@@ -0,0 +1,137 @@
+//
+// Hardware performance counters around the lex, reset and run phases, via perf_event_open.
+//
+
+#include <perf.h>
+#include <iomanip>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::vector<perf::phase_t> perf::phases;
+u64 perf::count_policy_t::executed = 0;
+static int fds[perf::counter_count] = { -1, -1, -1, -1, -1 };
+
+std::string perf::to_string(counter_e in) {
+   return (std::string[]) {
+      "cycles", "instructions", "branch-misses", "cache-misses", "page-faults"
+   }[in];
+}
+
+#ifdef __linux__
+static int open_counter(u32 type, u64 config) {
+   perf_event_attr attr { };
+   attr.size = sizeof(attr);
+   attr.type = type;
+   attr.config = config;
+   attr.disabled = 1;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv = 1;
+   attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+   return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+bool perf::open() {
+   bool any = false;
+#ifdef __linux__
+   const std::pair<u32, u64> configs[counter_count] = {
+         { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+         { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+         { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+         { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+         { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+   };
+   for (u32 i = 0; i < counter_count; i++) {
+      fds[i] = open_counter(configs[i].first, configs[i].second);
+      any |= fds[i] != -1;
+   }
+#endif
+   return any;
+}
+
+void perf::close() {
+#ifdef __linux__
+   for (int& fd : fds) {
+      if (fd != -1) {
+         ::close(fd);
+         fd = -1;
+      }
+   }
+#endif
+}
+
+void perf::begin() {
+#ifdef __linux__
+   for (int fd : fds) {
+      if (fd != -1) {
+         ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+         ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+   }
+#endif
+}
+
+void perf::end(ref(std::string) name, u64 statements) {
+   sample_t sample { };
+#ifdef __linux__
+   for (int fd : fds) {
+      if (fd != -1) {
+         ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+   }
+   for (u32 i = 0; i < counter_count; i++) {
+      // value, time enabled, time running
+      u64 buf[3];
+      if (fds[i] == -1 || read(fds[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) {
+         continue;
+      }
+      // scale up if the kernel had to multiplex the counter
+      sample.values[i] = buf[2] < buf[1] ? (u64) ((f64) buf[0] * (f64) buf[1] / (f64) buf[2]) : buf[0];
+      sample.available[i] = true;
+   }
+#endif
+   phases.push_back(phase_t { name, sample, statements });
+}
+
+void perf::report(mutref(std::ostream) out) {
+   out << std::setw(8) << "phase";
+   for (u32 i = 0; i < counter_count; i++) {
+      out << std::setw(16) << to_string((counter_e) i);
+   }
+   out << std::setw(8) << "IPC" << '\n';
+   for (ref(phase_t) phase : phases) {
+      ref(sample_t) s = phase.sample;
+      out << std::setw(8) << phase.name;
+      for (u32 i = 0; i < counter_count; i++) {
+         if (s.available[i]) {
+            out << std::setw(16) << s.values[i];
+         } else {
+            out << std::setw(16) << "n/a";
+         }
+      }
+      if (s.available[cycles] && s.available[instructions] && s.values[cycles] != 0) {
+         out << std::setw(8) << std::fixed << std::setprecision(2)
+             << (f64) s.values[instructions] / (f64) s.values[cycles];
+      } else {
+         out << std::setw(8) << "n/a";
+      }
+      out << '\n';
+      if (phase.statements == 0) {
+         continue;
+      }
+      out << std::setw(8) << "/stmt";
+      for (u32 i = 0; i < counter_count; i++) {
+         if (s.available[i]) {
+            out << std::setw(16) << std::fixed << std::setprecision(3) << (f64) s.values[i] / (f64) phase.statements;
+         } else {
+            out << std::setw(16) << "n/a";
+         }
+      }
+      out << std::setw(8) << "" << "  (" << phase.statements << " statements)\n";
+   }
+}
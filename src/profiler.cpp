@@ -0,0 +1,76 @@
+//
+// Per-statement execution profiler, hooked into interpreter::run_with as a policy.
+//
+
+#include <profiler.h>
+#include <interpreter.h>
+#include <lexer.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+std::vector<profiler::stmt_stats_t> profiler::stats;
+
+void profiler::reset(u32 stmts) {
+   stats.assign(stmts, stmt_stats_t { });
+}
+
+// splits the lexed file into its lines, 1-indexed to match file_pos_t
+static std::vector<std::string> source_lines() {
+   std::vector<std::string> lines { "" };
+   std::stringstream ss(lexer::file);
+   std::string line;
+   while (std::getline(ss, line)) {
+      lines.push_back(line);
+   }
+   return lines;
+}
+
+void profiler::report(mutref(std::ostream) out, u32 top, bool annotate) {
+   std::vector<std::string> lines = source_lines();
+   // fold statements into the line they start on
+   std::vector<stmt_stats_t> perLine(lines.size() + 1, stmt_stats_t { });
+   u64 totalCount = 0, totalTicks = 0;
+   for (u32 i = 0; i < stats.size() && i < interpreter::positions.size(); i++) {
+      u32 line = std::min<u32>(interpreter::positions[i].sLine, lines.size());
+      perLine[line].count += stats[i].count;
+      perLine[line].ticks += stats[i].ticks;
+      totalCount += stats[i].count;
+      totalTicks += stats[i].ticks;
+   }
+
+   std::vector<u32> hot;
+   for (u32 i = 1; i < perLine.size(); i++) {
+      if (perLine[i].count != 0) {
+         hot.push_back(i);
+      }
+   }
+   std::sort(hot.begin(), hot.end(), [&](u32 a, u32 b) {
+      return perLine[a].ticks > perLine[b].ticks;
+   });
+
+   out << "profile: " << totalCount << " statements executed, " << totalTicks << ' ' << tick_unit() << '\n';
+   out << std::setw(6) << "line" << std::setw(12) << "count" << std::setw(16) << tick_unit()
+       << std::setw(8) << "%" << "  source\n";
+   for (u32 i = 0; i < hot.size() && i < top; i++) {
+      ref(stmt_stats_t) it = perLine[hot[i]];
+      f64 pct = totalTicks == 0 ? 0 : 100.0 * (f64) it.ticks / (f64) totalTicks;
+      out << std::setw(6) << hot[i] << std::setw(12) << it.count << std::setw(16) << it.ticks
+          << std::setw(7) << std::fixed << std::setprecision(2) << pct << "%  "
+          << (hot[i] < lines.size() ? lines[hot[i]] : "") << '\n';
+   }
+
+   if (!annotate) {
+      return;
+   }
+   out << '\n';
+   for (u32 i = 1; i < lines.size(); i++) {
+      ref(stmt_stats_t) it = perLine[i];
+      if (it.count == 0) {
+         out << std::setw(12) << "" << std::setw(16) << "";
+      } else {
+         out << std::setw(12) << it.count << std::setw(16) << it.ticks;
+      }
+      out << " | " << lines[i] << '\n';
+   }
+}
@@ -0,0 +1,279 @@
+//
+// Builtin reductions and sort over arrays, split over parallel::each for large ones.
+//
+// an array holds pointers to its values, so every block of it is first packed into a buffer of plain
+// numbers, which the kernels then run over in four independent lanes the compiler can vectorise. each
+// block reduces to one result, and the blocks' results are combined in order on the calling thread.
+// sort packs every element with its key, sorts the blocks with std::stable_sort and merges neighbouring
+// runs of them in rounds, every round's merges spread over the threads too. being stable throughout, the
+// order of equal elements is the one they had.
+//
+
+#include <reduce.h>
+#include <parallel.h>
+#include <alloc.h>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+using namespace interpreter;
+
+reduce::kind_e reduce::kind_of(ref(std::string) name) {
+   if (name == "sum") {
+      return sum;
+   }
+   if (name == "product") {
+      return product;
+   }
+   if (name == "min") {
+      return min;
+   }
+   if (name == "max") {
+      return max;
+   }
+   if (name == "count") {
+      return count;
+   }
+   return sort;
+}
+
+// every block's index range
+static inline u64 block_end(u64 block, u64 size) {
+   return std::min(size, (block + 1) * reduce::block);
+}
+
+static inline u32 blocks_of(u64 size) {
+   return (size + reduce::block - 1) / reduce::block;
+}
+
+// the dominant type of an array's numbers, like basic_op's, -1 when it holds anything else
+static i32 numeric_type(ref(array_t) in) {
+   u32 blocks = blocks_of(in.size());
+   std::vector<i32> types(blocks, data_type_e::chr);
+   parallel::each(blocks, [&](u32, u32 b) {
+      for (u64 i = b * (u64) reduce::block; i < block_end(b, in.size()); i++) {
+         ref(data_t) it = in[i];
+         if (it.type > data_type_e::fp || it.data == nullptr) {
+            types[b] = -1;
+            return;
+         }
+         types[b] = std::max(types[b], (i32) it.type);
+      }
+   });
+   i32 out = data_type_e::chr;
+   for (i32 it : types) {
+      if (it == -1) {
+         return -1;
+      }
+      out = std::max(out, it);
+   }
+   return out;
+}
+
+template<typename t>
+static inline t number(ref(data_t) in) {
+   switch (in.type) {
+      case data_type_e::chr:
+         return (t) any_cast<char>(in.data);
+      case data_type_e::integer:
+         return (t) any_cast<i64>(in.data);
+      default:
+         return (t) any_cast<f64>(in.data);
+   }
+}
+
+// packs a block's numbers into this thread's buffer
+template<typename t>
+static ptr(t) pack(ref(array_t) in, u32 b, mutref(u64) size) {
+   static thread_local std::vector<t> buffer;
+   u64 first = b * (u64) reduce::block;
+   size = block_end(b, in.size()) - first;
+   buffer.resize(size);
+   for (u64 i = 0; i < size; i++) {
+      buffer[i] = number<t>(in[first + i]);
+   }
+   return buffer.data();
+}
+
+template<typename t, bool multiply>
+static t fold(ptr(t) in, u64 size) {
+   t lanes[4];
+   std::fill(lanes, lanes + 4, multiply ? 1 : 0);
+   u64 i = 0;
+   for (; i + 4 <= size; i += 4) {
+      for (u32 l = 0; l < 4; l++) {
+         lanes[l] = multiply ? lanes[l] * in[i + l] : lanes[l] + in[i + l];
+      }
+   }
+   for (; i < size; i++) {
+      lanes[0] = multiply ? lanes[0] * in[i] : lanes[0] + in[i];
+   }
+   return multiply ? (lanes[0] * lanes[1]) * (lanes[2] * lanes[3]) : (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+template<typename t, bool multiply>
+static t fold_array(ref(array_t) in) {
+   std::vector<t> partial(blocks_of(in.size()));
+   parallel::each(partial.size(), [&](u32, u32 b) {
+      u64 size;
+      ptr(t) packed = pack<t>(in, b, size);
+      partial[b] = fold<t, multiply>(packed, size);
+   });
+   return fold<t, multiply>(partial.data(), partial.size());
+}
+
+static runtime_res_t arithmetic(ref(array_t) in, bool multiply) {
+   i32 type = numeric_type(in);
+   if (type == -1) {
+      return { empty_data_t, "interpreter::run@reduce: cannot sum or multiply non-numbers" };
+   }
+   if (type == data_type_e::fp) {
+      f64 res = multiply ? fold_array<f64, true>(in) : fold_array<f64, false>(in);
+      return { data_t { data_type_e::fp, alloc::make<f64>(alloc::arithmetic, res) }, "" };
+   }
+   i64 res = multiply ? fold_array<i64, true>(in) : fold_array<i64, false>(in);
+   if (type == data_type_e::chr && !in.empty()) {
+      return { data_t { data_type_e::chr, alloc::make<char>(alloc::arithmetic, (char) res) }, "" };
+   }
+   return { data_t { data_type_e::integer, alloc::make<i64>(alloc::arithmetic, res) }, "" };
+}
+
+// the least or greatest number, compared as comp_op does, the first of equal ones
+static runtime_res_t extreme(ref(array_t) in, bool greatest) {
+   if (in.empty()) {
+      return { empty_data_t, "interpreter::run@reduce: an empty array has no least or greatest element" };
+   }
+   if (numeric_type(in) == -1) {
+      return { empty_data_t, "interpreter::run@reduce: cannot compare non-numbers" };
+   }
+   u32 blocks = blocks_of(in.size());
+   std::vector<std::pair<f64, u64>> best(blocks);
+   parallel::each(blocks, [&](u32, u32 b) {
+      u64 size;
+      ptr(f64) packed = pack<f64>(in, b, size);
+      u64 at = 0;
+      for (u64 i = 1; i < size; i++) {
+         if (greatest ? packed[i] > packed[at] : packed[i] < packed[at]) {
+            at = i;
+         }
+      }
+      best[b] = { packed[at], b * (u64) reduce::block + at };
+   });
+   std::pair<f64, u64> out = best[0];
+   for (ref(auto) it : best) {
+      if (greatest ? it.first > out.first : it.first < out.first) {
+         out = it;
+      }
+   }
+   return { in[out.second], "" };
+}
+
+static runtime_res_t truthy(ref(array_t) in) {
+   u32 blocks = blocks_of(in.size());
+   std::vector<i64> counts(blocks, 0);
+   parallel::each(blocks, [&](u32, u32 b) {
+      for (u64 i = b * (u64) reduce::block; i < block_end(b, in.size()); i++) {
+         counts[b] += in[i].data != nullptr && is_true(in[i]);
+      }
+   });
+   i64 out = 0;
+   for (i64 it : counts) {
+      out += it;
+   }
+   return { data_t { data_type_e::integer, alloc::make<i64>(alloc::arithmetic, out) }, "" };
+}
+
+static inline bool before(i64 a, i64 b) {
+   return a < b;
+}
+
+static inline bool before(f64 a, f64 b) {
+   return a < b;
+}
+
+static inline bool before(ptr(std::string) a, ptr(std::string) b) {
+   return *a < *b;
+}
+
+template<typename key_t>
+static runtime_res_t sort_by(ref(array_t) in) {
+   typedef std::pair<key_t, data_t> entry_t;
+   u64 size = in.size();
+   u32 blocks = blocks_of(size);
+   auto less = [](ref(entry_t) a, ref(entry_t) b) { return before(a.first, b.first); };
+   std::vector<entry_t> entries(size), merged(size);
+   parallel::each(blocks, [&](u32, u32 b) {
+      u64 first = b * (u64) reduce::block, end = block_end(b, size);
+      for (u64 i = first; i < end; i++) {
+         if constexpr (std::is_same<key_t, ptr(std::string)>::value) {
+            entries[i] = { (ptr(std::string)) in[i].data, in[i] };
+         } else {
+            entries[i] = { number<key_t>(in[i]), in[i] };
+         }
+      }
+      std::stable_sort(entries.begin() + first, entries.begin() + end, less);
+   });
+   // runs of width elements are sorted, each round merges them in pairs
+   for (u64 width = reduce::block; width < size; width *= 2) {
+      u32 pairs = (size + 2 * width - 1) / (2 * width);
+      parallel::each(pairs, [&](u32, u32 p) {
+         u64 first = p * 2 * width, mid = std::min(size, first + width), end = std::min(size, first + 2 * width);
+         std::merge(entries.begin() + first, entries.begin() + mid, entries.begin() + mid, entries.begin() + end,
+                    merged.begin() + first, less);
+      });
+      entries.swap(merged);
+   }
+   mutptr(array_t) out = alloc::make<array_t>(alloc::arithmetic, size);
+   for (u64 i = 0; i < size; i++) {
+      (*out)[i] = entries[i].second;
+   }
+   return { data_t { data_type_e::array, out }, "" };
+}
+
+static runtime_res_t sorted(ref(array_t) in) {
+   bool strings = !in.empty();
+   for (ref(data_t) it : in) {
+      strings = strings && it.type == data_type_e::str;
+   }
+   if (strings) {
+      return sort_by<ptr(std::string)>(in);
+   }
+   i32 type = numeric_type(in);
+   if (type == -1) {
+      return { empty_data_t, "interpreter::run@reduce: can only sort all numbers or all strings" };
+   }
+   return type == data_type_e::fp ? sort_by<f64>(in) : sort_by<i64>(in);
+}
+
+runtime_res_t reduce::exec(ref(statement_t) stmt) {
+   u32 src = any_cast<u32>(stmt[0].data), dst = any_cast<u32>(stmt[1].data);
+   if (stacks[src].empty() || stacks[src].top().type != data_type_e::array) {
+      return { empty_data_t, "interpreter::run@reduce: stack reduced does not hold an array" };
+   }
+   if (stacks[dst].empty()) {
+      return { empty_data_t, "interpreter::run@reduce: stack reduced to is empty" };
+   }
+   ref(array_t) in = *(ptr(array_t)) stacks[src].top().data;
+   runtime_res_t res;
+   switch (any_cast<kind_e>(stmt[2].data)) {
+      case sum:
+      case product:
+         res = arithmetic(in, any_cast<kind_e>(stmt[2].data) == product);
+         break;
+      case min:
+      case max:
+         res = extreme(in, any_cast<kind_e>(stmt[2].data) == max);
+         break;
+      case count:
+         res = truthy(in);
+         break;
+      case sort:
+         res = sorted(in);
+         break;
+   }
+   if (!res.second.empty()) {
+      return res;
+   }
+   stacks[dst].top() = res.first;
+   return { empty_data_t, "" };
+}
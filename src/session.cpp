@@ -0,0 +1,141 @@
+//
+// Programs run a slice at a time, so one thread can take turns between many of them.
+//
+// the interpreter keeps one program and where it is in globals, so a step swaps the session's in for
+// them, runs the statements under a policy that stops before any statement once the budget is spent or at
+// a read with nothing to read, and swaps them back. stdin and stdout are pointed at the session's own
+// input and output meanwhile. what a session can do is what a run can, bar spawning stages, which would
+// go on running the program after the step had swapped it out.
+//
+
+#include <session.h>
+#include <lexer.h>
+#include <depth.h>
+#include <timing.h>
+#include <iostream>
+#include <limits>
+
+using namespace interpreter;
+
+thread_local session::slice_t session::slice;
+// the session stepping on this thread
+static thread_local mutptr(session::session_t) stepping = nullptr;
+
+// how many statements run between looks at the clock
+static const u32 clock_every = 64;
+
+// swaps a session's program and stacks with the interpreter's
+static void swap_program(mutref(session::session_t) s) {
+   statements.swap(s.statements);
+   positions.swap(s.positions);
+   proven.swap(s.proven);
+}
+
+void session::load(mutref(session_t) s, ref(std::string) source) {
+   lexer::reset(source);
+   std::vector<lexer::tok_t> toks = lexer::lex();
+   if (!lexer::error.empty()) {
+      s.status = failed;
+      s.error = lexer::error;
+      return;
+   }
+   // reset makes new stacks for the thread, which become the session's
+   mutptr(stack_t) saved = stacks;
+   stacks = nullptr;
+   swap_program(s);
+   interpreter::reset(toks);
+   std::string underflows = depth::analyse();
+   swap_program(s);
+   s.stacks.assign(stacks, stacks + 32);
+   delete[] stacks;
+   stacks = saved;
+   s.returns.clear();
+   s.current = 0;
+   s.status = underflows.empty() ? ready : failed;
+   s.error = underflows;
+}
+
+void session::feed(mutref(session_t) s, ref(std::string) text) {
+   for (char c : text) {
+      bool space = std::isspace((unsigned char) c);
+      s.words += space && s.partial;
+      s.partial = !space;
+   }
+   s.input << text;
+   if (s.status == waiting) {
+      s.status = ready;
+   }
+}
+
+void session::close(mutref(session_t) s) {
+   s.words += s.partial;
+   s.partial = false;
+   s.closed = true;
+   if (s.status == waiting) {
+      s.status = ready;
+   }
+}
+
+std::string session::take_output(mutref(session_t) s) {
+   std::string out = s.output.str();
+   s.output.str("");
+   return out;
+}
+
+bool session::out_of_time() {
+   slice.untilClock = clock_every;
+   if (timing::wall_ns() < slice.deadline) {
+      return false;
+   }
+   return true;
+}
+
+bool session::starved() {
+   if (stepping->words > 0) {
+      stepping->words--;
+      return false;
+   }
+   if (stepping->closed) {
+      return false;
+   }
+   stepping->status = waiting;
+   return true;
+}
+
+session::status_e session::step(mutref(session_t) s, ref(budget_t) budget) {
+   if (s.status != ready) {
+      return s.status;
+   }
+   u64 limit = budget.statements == 0 ? std::numeric_limits<u64>::max() : budget.statements;
+   slice = slice_t {
+         limit, budget.micros == 0 ? std::numeric_limits<u64>::max() : timing::wall_ns() + budget.micros * 1000,
+         clock_every
+   };
+   mutptr(session_t) outer = stepping;
+   stepping = &s;
+   mutptr(stack_t) saved = stacks;
+   stacks = s.stacks.data();
+   std::streambuf* oldIn = std::cin.rdbuf(s.input.rdbuf());
+   std::streambuf* oldOut = std::cout.rdbuf(s.output.rdbuf());
+   std::ios::iostate inState = std::cin.rdstate();
+   std::cin.clear();
+   swap_program(s);
+
+   runtime_res_t res = run_from<policy_t>(s.current, s.returns);
+
+   swap_program(s);
+   std::cin.clear(inState);
+   std::cin.rdbuf(oldIn);
+   std::cout.rdbuf(oldOut);
+   stacks = saved;
+   stepping = outer;
+   s.executed += limit - slice.left;
+   s.steps++;
+   if (!res.second.empty()) {
+      s.status = failed;
+      s.error = res.second;
+   } else if (s.current >= s.statements.size()) {
+      s.status = finished;
+   }
+   return s.status;
+}
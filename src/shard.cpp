@@ -0,0 +1,161 @@
+//
+// Sharding: the loaded program run by forked processes, each over its own piece of one input file.
+//
+// the program is lexed, loaded and analysed once, before forking, so every process starts from the same
+// statements, which stay shared until written. the input is mapped once and every process reads its piece
+// of it in place. output goes to a region of anonymous shared memory per piece, reserved up front and
+// written directly through std::cout, which the parent writes out in order once every process is done.
+// a process ends with _exit, so nothing it inherited is flushed or torn down twice.
+//
+
+#include <shard.h>
+#include <interpreter.h>
+#include <algorithm>
+#include <iostream>
+#include <streambuf>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+shard::stats_t shard::stats;
+
+// what a process tells the parent, at the start of its region
+struct alignas(64) header_t {
+   u64 used;
+   u32 failed, full;
+};
+
+// reads straight from the mapped input
+struct view_buf_t : std::streambuf {
+   view_buf_t(mutptr(char) begin, mutptr(char) end) {
+      setg(begin, begin, end);
+   }
+};
+
+// writes straight into the shared region, failing once it is full
+struct region_buf_t : std::streambuf {
+   bool full = false;
+
+   region_buf_t(mutptr(char) begin, u64 size) {
+      setp(begin, begin + size);
+   }
+
+   u64 used() const {
+      return pptr() - pbase();
+   }
+
+   int_type overflow(int_type) override {
+      full = true;
+      return traits_type::eof();
+   }
+};
+
+// runs the program over one piece in this process, which it never returns from
+[[noreturn]] static void work(mutptr(char) begin, mutptr(char) end, mutptr(header_t) header) {
+   view_buf_t in(begin, end);
+   region_buf_t out((mutptr(char)) (header + 1), shard::out_capacity);
+   std::cin.rdbuf(&in);
+   std::cout.rdbuf(&out);
+   interpreter::runtime_res_t res = interpreter::run();
+   if (!res.second.empty()) {
+      std::cout << res.second;
+   }
+   header->used = out.used();
+   header->full = out.full;
+   header->failed = !res.second.empty() || out.full;
+   _exit(0);
+}
+
+bool shard::run(ref(std::string) path, u32 workers, mutref(std::ostream) out) {
+   i32 fd = path.empty() ? 0 : open(path.c_str(), O_RDONLY);
+   struct stat st { };
+   if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      out << "shard::run: input has to be a file that can be mapped";
+      return false;
+   }
+   u64 size = st.st_size;
+   mutptr(char) input = nullptr;
+   if (size != 0) {
+      input = (mutptr(char)) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (input == MAP_FAILED) {
+         out << "shard::run: input could not be mapped";
+         return false;
+      }
+   }
+   if (!path.empty()) {
+      close(fd);
+   }
+
+   // piece boundaries, each moved on past the next newline. pieces left empty are not run, unless the
+   // input is
+   workers = std::max(workers, 1u);
+   std::vector<u64> bounds { 0 };
+   for (u32 w = 1; w < workers; w++) {
+      u64 at = std::max(size * w / workers, bounds.back());
+      while (at < size && at != 0 && input[at - 1] != '\n') {
+         at++;
+      }
+      if (at != bounds.back() && at != size) {
+         bounds.push_back(at);
+      }
+   }
+   bounds.push_back(size);
+   u32 count = bounds.size() - 1;
+
+   u64 stride = sizeof(header_t) + out_capacity;
+   mutptr(char) regions = (mutptr(char)) mmap(nullptr, stride * count, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (regions == MAP_FAILED) {
+      out << "shard::run: no room for the output of " << count << " shards";
+      if (input != nullptr) {
+         munmap(input, size);
+      }
+      return false;
+   }
+
+   // nothing buffered is to be written by every process
+   std::cout.flush();
+   std::cerr.flush();
+   std::vector<pid_t> pids(count, -1);
+   for (u32 s = 0; s < count; s++) {
+      mutptr(header_t) header = (mutptr(header_t)) (regions + stride * s);
+      pids[s] = fork();
+      if (pids[s] == 0) {
+         work(input + bounds[s], input + bounds[s + 1], header);
+      }
+   }
+
+   bool ok = true;
+   for (u32 s = 0; s < count; s++) {
+      mutptr(header_t) header = (mutptr(header_t)) (regions + stride * s);
+      i32 status = 0;
+      if (pids[s] < 0 || waitpid(pids[s], &status, 0) < 0 || !WIFEXITED(status)) {
+         header->failed = 1;
+      }
+      out.write((ptr(char)) (header + 1), header->used);
+      stats.bytesOut += header->used;
+      if (pids[s] < 0) {
+         out << "shard::run: could not fork for shard " << s;
+      } else if (!WIFEXITED(status)) {
+         out << "shard::run: shard " << s << " was killed by signal " << WTERMSIG(status);
+      } else if (header->full) {
+         out << "shard::run: shard " << s << " printed more than " << out_capacity << " bytes";
+      }
+      ok &= !header->failed;
+   }
+   stats.shards += count;
+   stats.bytesIn += size;
+   munmap(regions, stride * count);
+   if (input != nullptr) {
+      munmap(input, size);
+   }
+   return ok;
+}
+
+void shard::report(mutref(std::ostream) out) {
+   out << "shard: " << stats.shards << " shards, " << stats.bytesIn << " bytes in, " << stats.bytesOut
+       << " bytes out\n";
+}
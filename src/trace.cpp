@@ -0,0 +1,459 @@
+//
+// Trace recording of hot loops, hooked into interpreter::run_with as a policy.
+//
+// every backward jump is counted. once one has been taken threshold times, the statements executed
+// from its target until it is taken again are recorded, together with the types of the values they
+// used and the way their jumps went. the recording is then compiled into a flat list of trace ops:
+// arithmetic on the recorded types is done inline behind type guards, jumps and returns become guards
+// on the recorded direction, and anything else calls the interpreter's exec_* helpers. a failing guard
+// is a side exit, the trace stops before the statement and the interpreter carries on from it.
+//
+
+#include <trace.h>
+#include <alloc.h>
+#include <parallel.h>
+#include <reduce.h>
+#include <channel.h>
+#include <coroutine.h>
+#include <cmath>
+#include <iomanip>
+
+using namespace interpreter;
+
+trace::stats_t trace::stats;
+bool trace::recording = false;
+
+// one executed statement and the types its operands had
+struct entry_t {
+   u32 stmt;
+   // jump back depth before the statement, a jump that was taken leaves it one deeper unless it is a
+   // tail call
+   u64 depth;
+   data_type_e types[2];
+   bool known[2];
+};
+
+enum op_kind_e {
+   generic,
+   arith,
+   push,
+   pop,
+   guard,
+   ret,
+   anchor
+};
+
+struct op_t {
+   op_kind_e kind;
+   u32 stmt;
+   // arith: the operands' type. guard: whether the jump was taken. ret: the statement returned to
+   data_type_e type;
+   u32 expected;
+   runtime_res_t (* exec)(ref(statement_t));
+};
+
+struct trace_t {
+   u32 head, anchor;
+   std::vector<op_t> ops;
+   u32 specialised, guards;
+   u64 entered, iterations, exits;
+};
+
+static std::vector<u32> counts, aborts;
+// index into traces of the trace anchored at a statement, -1 for none
+static std::vector<i32> compiled;
+static std::vector<trace_t> traces;
+static std::vector<entry_t> entries;
+static u32 recordingAnchor = 0;
+
+void trace::reset(u32 stmts) {
+   stats = stats_t { };
+   recording = false;
+   counts.assign(stmts, 0);
+   aborts.assign(stmts, 0);
+   compiled.assign(stmts, -1);
+   traces.clear();
+   entries.clear();
+}
+
+// the type a node evaluates to, if it is a literal or a non-empty stack
+static bool observe(ref(node_t) node, mutref(data_type_e) out) {
+   switch (node.type) {
+      case lexer::integer:
+         out = data_type_e::integer;
+         return true;
+      case lexer::fp:
+         out = data_type_e::fp;
+         return true;
+      case lexer::chr:
+         out = data_type_e::chr;
+         return true;
+      case lexer::str:
+         out = data_type_e::str;
+         return true;
+      case lexer::stack: {
+         ref(stack_t) stack = stacks[any_cast<u32>(node.data)];
+         if (stack.empty()) {
+            return false;
+         }
+         out = stack.top().type;
+         return true;
+      }
+      default:
+         return false;
+   }
+}
+
+static void abort_recording() {
+   trace::recording = false;
+   entries.clear();
+   aborts[recordingAnchor]++;
+   trace::stats.aborted++;
+}
+
+void trace::record(u32 stmt) {
+   if (entries.size() >= max_length) {
+      abort_recording();
+      return;
+   }
+   ref(statement_t) it = statements[stmt];
+   entry_t entry { stmt, returns.size() };
+   for (u32 i = 0; i < 2; i++) {
+      entry.known[i] = i + 1 < it.size() && observe(it[i], entry.types[i]);
+   }
+   entries.push_back(entry);
+}
+
+// whether an operation can be done inline on the recorded operand types
+static bool specialisable(ref(statement_t) stmt, ref(entry_t) entry) {
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (stmt.size() < 3 || stmt[0].type == lexer::sub || stmt[stmt.size() - 2].type != lexer::stack) {
+      return false;
+   }
+   if (!entry.known[0] || !entry.known[1] || entry.types[0] != entry.types[1]) {
+      return false;
+   }
+   data_type_e type = entry.types[0];
+   switch (op) {
+      case lexer::add:
+      case lexer::sub:
+      case lexer::mul:
+      case lexer::div:
+      case lexer::mod:
+         return type == data_type_e::integer || type == data_type_e::fp;
+      case lexer::idiv:
+         return type == data_type_e::integer;
+      case lexer::eq:
+      case lexer::neq:
+         return type == data_type_e::integer || type == data_type_e::fp || type == data_type_e::chr;
+      default:
+         return false;
+   }
+}
+
+// turns the recorded entries into a trace, false when they do not form the loop
+static bool compile(u32 head) {
+   if (entries.empty() || entries[0].stmt != head || entries.back().stmt != recordingAnchor) {
+      return false;
+   }
+   trace_t t { head, recordingAnchor };
+   for (u32 k = 0; k < entries.size(); k++) {
+      ref(entry_t) entry = entries[k];
+      ref(statement_t) stmt = statements[entry.stmt];
+      op_t op { generic, entry.stmt, entry.types[0], 0, nullptr };
+      switch (stmt[stmt.size() - 1].type) {
+         case lexer::add:
+         case lexer::sub:
+         case lexer::mul:
+         case lexer::div:
+         case lexer::idiv:
+         case lexer::mod:
+         case lexer::eq:
+         case lexer::neq:
+         case lexer::gt:
+         case lexer::lt:
+         case lexer::gte:
+         case lexer::lte:
+         case lexer::and_:
+         case lexer::or_:
+         case lexer::xor_:
+            if (specialisable(stmt, entry)) {
+               op.kind = arith;
+               t.specialised++;
+            } else {
+               op.exec = exec_op;
+            }
+            break;
+         case lexer::print:
+            op.exec = exec_print;
+            break;
+         case lexer::stack:
+            op.exec = exec_set;
+            break;
+         case lexer::cast:
+            op.exec = exec_cast;
+            break;
+         case lexer::read:
+            op.exec = exec_read;
+            break;
+         case lexer::map:
+            op.exec = parallel::map;
+            break;
+         case lexer::reduce:
+            op.exec = reduce::exec;
+            break;
+         case lexer::send:
+            op.exec = channel::send;
+            break;
+         case lexer::receive:
+            op.exec = channel::receive;
+            break;
+         case lexer::spawn:
+            op.exec = channel::spawn;
+            break;
+         case lexer::coroutine:
+            op.exec = coroutine::create;
+            break;
+         case lexer::resume:
+            op.exec = coroutine::resume;
+            break;
+         case lexer::done:
+            op.exec = coroutine::done;
+            break;
+         case lexer::yield:
+            // fails, as the traced program is not a coroutine
+            op.exec = coroutine::yield;
+            break;
+         case lexer::push:
+            op.kind = push;
+            break;
+         case lexer::pop:
+            op.kind = pop;
+            break;
+         case lexer::jump:
+            if (k + 1 == entries.size()) {
+               op.kind = anchor;
+            } else {
+               op.kind = guard;
+               // a tail call leaves the depth alone, so only where it went tells whether it was taken
+               op.expected = tail_call(entry.stmt) ? entries[k + 1].stmt != entry.stmt + 1
+                                                   : entries[k + 1].depth > entry.depth;
+               t.guards++;
+            }
+            break;
+         case lexer::endf:
+            op.kind = ret;
+            op.expected = k + 1 < entries.size() ? entries[k + 1].stmt : head;
+            t.guards++;
+            break;
+         default:
+            // beginf and labels only move to the next entry
+            continue;
+      }
+      t.ops.push_back(op);
+   }
+   compiled[recordingAnchor] = (i32) traces.size();
+   traces.push_back(t);
+   entries.clear();
+   return true;
+}
+
+// an operand of a specialised op, false when its type is not the recorded one
+static inline bool load(ref(node_t) node, data_type_e type, mutref(void*) out) {
+   if (node.type != lexer::stack) {
+      out = node.data;
+      return true;
+   }
+   ref(stack_t) stack = stacks[any_cast<u32>(node.data)];
+   if (stack.empty() || stack.top().type != type) {
+      return false;
+   }
+   out = stack.top().data;
+   return true;
+}
+
+template<typename t>
+static inline data_t compute(lexer::tok_type_e op, data_type_e type, t a, t b) {
+   switch (op) {
+      case lexer::add:
+         return { type, alloc::make<t>(alloc::arithmetic, a + b) };
+      case lexer::sub:
+         return { type, alloc::make<t>(alloc::arithmetic, a - b) };
+      case lexer::mul:
+         return { type, alloc::make<t>(alloc::arithmetic, a * b) };
+      case lexer::div:
+      case lexer::idiv:
+         return { type, alloc::make<t>(alloc::arithmetic, a / b) };
+      case lexer::eq:
+         return { data_type_e::chr, alloc::make<char>(alloc::comparison, a == b) };
+      default:
+         return { data_type_e::chr, alloc::make<char>(alloc::comparison, a != b) };
+   }
+}
+
+// the jump's condition, 0 false, 1 true, -1 when it cannot be evaluated and the interpreter should
+static inline i32 condition(ref(statement_t) stmt) {
+   bool neg = stmt[0].type == lexer::not_;
+   ref(node_t) node = stmt[neg];
+   data_t dat;
+   switch (node.type) {
+      case lexer::stack: {
+         ref(stack_t) stack = stacks[any_cast<u32>(node.data)];
+         if (stack.empty()) {
+            return -1;
+         }
+         dat = stack.top();
+         break;
+      }
+      case lexer::integer:
+         dat = { data_type_e::integer, node.data };
+         break;
+      case lexer::fp:
+         dat = { data_type_e::fp, node.data };
+         break;
+      case lexer::chr:
+         dat = { data_type_e::chr, node.data };
+         break;
+      case lexer::str:
+         dat = { data_type_e::str, node.data };
+         break;
+      default:
+         return -1;
+   }
+   return is_true(dat) != neg;
+}
+
+// runs a trace from its head until a guard fails, the loop exits or an error occurs
+static void run(mutref(trace_t) t, mutref(u32) current, mutref(std::string) error) {
+   t.entered++;
+   trace::stats.entered++;
+   while (true) {
+      for (ref(op_t) op : t.ops) {
+         ref(statement_t) stmt = statements[op.stmt];
+         switch (op.kind) {
+            case generic: {
+               runtime_res_t res = op.exec(stmt);
+               if (!res.second.empty()) {
+                  error = res.second;
+                  current = op.stmt;
+                  return;
+               }
+               break;
+            }
+            case arith: {
+               void* a;
+               void* b;
+               mutref(stack_t) dest = stacks[any_cast<u32>(stmt[stmt.size() - 2].data)];
+               if (!load(stmt[0], op.type, a) || !load(stmt[1], op.type, b) || dest.empty()) {
+                  goto Exit;
+               }
+               lexer::tok_type_e kind = stmt[stmt.size() - 1].type;
+               switch (op.type) {
+                  case data_type_e::integer:
+                     if (kind == lexer::mod) {
+                        dest.top() = { data_type_e::integer, alloc::make<i64>(alloc::arithmetic, *(i64*) a % *(i64*) b) };
+                     } else {
+                        dest.top() = compute<i64>(kind, op.type, *(i64*) a, *(i64*) b);
+                     }
+                     break;
+                  case data_type_e::fp:
+                     if (kind == lexer::mod) {
+                        dest.top() = { data_type_e::fp, alloc::make<f64>(alloc::arithmetic, fmod(*(f64*) a, *(f64*) b)) };
+                     } else {
+                        dest.top() = compute<f64>(kind, op.type, *(f64*) a, *(f64*) b);
+                     }
+                     break;
+                  default:
+                     dest.top() = compute<char>(kind, op.type, *(char*) a, *(char*) b);
+               }
+               break;
+            }
+            case push:
+               stacks[any_cast<u32>(stmt[0].data)].push(data_t { });
+               break;
+            case pop:
+               stacks[any_cast<u32>(stmt[0].data)].pop();
+               break;
+            case guard: {
+               i32 taken = condition(stmt);
+               if (taken != (i32) op.expected) {
+                  goto Exit;
+               }
+               if (taken && !tail_call(op.stmt)) {
+                  push_return(op.stmt + 1);
+               }
+               break;
+            }
+            case ret: {
+               runtime_res_t res = pop_return(current);
+               if (!res.second.empty()) {
+                  error = res.second;
+                  return;
+               }
+               if (current != op.expected) {
+                  t.exits++;
+                  trace::stats.exits++;
+                  return;
+               }
+               break;
+            }
+            case anchor: {
+               i32 taken = condition(stmt);
+               if (taken == -1) {
+                  goto Exit;
+               }
+               if (!taken) {
+                  current = op.stmt + 1;
+                  return;
+               }
+               if (!tail_call(op.stmt)) {
+                  push_return(op.stmt + 1);
+               }
+               t.iterations++;
+               trace::stats.iterations++;
+               break;
+            }
+         }
+         continue;
+
+         Exit:
+         // the statement has not been touched, the interpreter runs it again
+         t.exits++;
+         trace::stats.exits++;
+         current = op.stmt;
+         return;
+      }
+   }
+}
+
+void trace::back_edge(u32 from, mutref(u32) current, mutref(std::string) error) {
+   if (recording) {
+      recording = false;
+      if (from == recordingAnchor && compile(current)) {
+         stats.recorded++;
+      } else {
+         abort_recording();
+      }
+   }
+   if (compiled[from] >= 0) {
+      run(traces[compiled[from]], current, error);
+      return;
+   }
+   if (aborts[from] >= max_aborts || ++counts[from] < threshold) {
+      return;
+   }
+   counts[from] = 0;
+   recordingAnchor = from;
+   entries.clear();
+   recording = true;
+}
+
+void trace::report(mutref(std::ostream) out) {
+   out << "trace: " << stats.recorded << " recorded, " << stats.aborted << " aborted, " << stats.entered
+       << " entered, " << stats.iterations << " iterations, " << stats.exits << " side exits\n";
+   for (ref(trace_t) t : traces) {
+      out << "  line " << std::setw(4) << positions[t.head].sLine << " to " << std::setw(4) << positions[t.anchor].sLine
+          << ": " << t.ops.size() << " ops, " << t.specialised << " specialised, " << t.guards << " guards, entered "
+          << t.entered << ", " << t.iterations << " iterations, " << t.exits << " side exits\n";
+   }
+}
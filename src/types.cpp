@@ -0,0 +1,226 @@
+//
+// Type inference over the SSA form of interpreter::statements, finding the data_type_e a stack top can
+// have at every statement.
+//
+// every ir value gets the set of types it can hold. literals have their own, casts and reads produce a
+// known type, and operations follow basic_op, comp_op and logic_op over every pair of types their
+// operands can have, pairs they fail on producing nothing. phis hold whatever their arguments can, and
+// unknown values anything. the sets only grow, so they are recomputed until none changes.
+//
+
+#include <types.h>
+#include <ir.h>
+#include <reduce.h>
+#include <map>
+
+using namespace interpreter;
+
+std::vector<types::mask_t> types::values;
+
+// the values sharing each value number
+typedef std::map<u32, std::vector<u32>> numbered_t;
+
+static types::mask_t literal_mask(ref(node_t) in) {
+   switch (in.type) {
+      case lexer::chr:
+         return types::of(data_type_e::chr);
+      case lexer::integer:
+         return types::of(data_type_e::integer);
+      case lexer::fp:
+         return types::of(data_type_e::fp);
+      case lexer::str:
+         return types::of(data_type_e::str);
+      case lexer::array:
+         return types::of(data_type_e::array);
+      default:
+         return types::any;
+   }
+}
+
+types::mask_t types::before(u32 stmt, ref(node_t) in) {
+   if (in.type != lexer::stack) {
+      return literal_mask(in);
+   }
+   u32 idx = any_cast<u32>(in.data);
+   if (stmt >= ir::program.tops.size() || idx >= 26) {
+      return any;
+   }
+   return values[ir::program.tops[stmt][idx]];
+}
+
+i32 types::single(u32 stmt, ref(node_t) in) {
+   mask_t mask = before(stmt, in);
+   for (i32 t = data_type_e::chr; t <= data_type_e::array; t++) {
+      if (mask == of((data_type_e) t)) {
+         return t;
+      }
+   }
+   return -1;
+}
+
+// the type an operation on one type of value and another leaves, -1 when it fails. the empty value is
+// a chr as far as the operations can tell
+static i32 result(lexer::tok_type_e op, data_type_e one, data_type_e two) {
+   switch (op) {
+      case lexer::eq:
+      case lexer::neq:
+         return one == two ? data_type_e::chr : -1;
+      case lexer::gt:
+      case lexer::lt:
+      case lexer::gte:
+      case lexer::lte:
+         // comp_op hands back an empty value for these
+         return one > data_type_e::fp || two > data_type_e::fp ? -1 : data_type_e::chr;
+      case lexer::and_:
+      case lexer::or_:
+      case lexer::xor_:
+         return data_type_e::chr;
+      default:
+         break;
+   }
+   if (one != data_type_e::array && two == data_type_e::array) {
+      return -1;
+   }
+   if (op == lexer::idiv) {
+      return one == data_type_e::array ? -1 : data_type_e::integer;
+   }
+   data_type_e dominant = std::max(one, two);
+   if (dominant == data_type_e::str && op != lexer::add && op != lexer::mul) {
+      return -1;
+   }
+   return dominant;
+}
+
+// whether the value an operation leaves can be the empty one
+static bool leaves_blank(lexer::tok_type_e op) {
+   return op == lexer::gt || op == lexer::lt || op == lexer::gte || op == lexer::lte;
+}
+
+static types::mask_t operation_mask(lexer::tok_type_e op, types::mask_t one, types::mask_t two) {
+   types::mask_t out = 0;
+   for (u32 a = data_type_e::chr; a <= data_type_e::array; a++) {
+      if (!(one & types::of((data_type_e) a)) && !(a == data_type_e::chr && (one & types::blank))) {
+         continue;
+      }
+      for (u32 b = data_type_e::chr; b <= data_type_e::array; b++) {
+         if (!(two & types::of((data_type_e) b)) && !(b == data_type_e::chr && (two & types::blank))) {
+            continue;
+         }
+         i32 res = result(op, (data_type_e) a, (data_type_e) b);
+         if (res != -1) {
+            out |= leaves_blank(op) ? types::blank : types::of((data_type_e) res);
+         }
+      }
+   }
+   return out;
+}
+
+// negating anything but a number leaves the empty value
+static types::mask_t negated_mask(types::mask_t in) {
+   types::mask_t numbers = types::of(data_type_e::integer) | types::of(data_type_e::fp);
+   return (in & numbers) | (in & ~numbers ? types::blank : 0);
+}
+
+static types::mask_t cast_mask(data_type_e to, types::mask_t in) {
+   if (to == data_type_e::array) {
+      return in ? types::of(data_type_e::array) : 0;
+   }
+   return in & ~types::of(data_type_e::array) ? types::of(to) : 0;
+}
+
+static types::mask_t reduced_mask(reduce::kind_e kind) {
+   types::mask_t numbers = types::of(data_type_e::chr) | types::of(data_type_e::integer) | types::of(data_type_e::fp);
+   switch (kind) {
+      case reduce::count:
+         return types::of(data_type_e::integer);
+      case reduce::sort:
+         return types::of(data_type_e::array);
+      default:
+         return numbers;
+   }
+}
+
+// the types a defined value can have, given those of the values before its statement
+static types::mask_t defined_mask(u32 value, ref(numbered_t) byVn) {
+   ref(ir::value_t) it = ir::program.values[value];
+   ref(statement_t) stmt = statements[it.at];
+   lexer::tok_type_e op = stmt[stmt.size() - 1].type;
+   if (ir::is_op(op)) {
+      if (stmt[0].type == lexer::sub) {
+         types::mask_t in = types::before(it.at, stmt[1]);
+         return operation_mask(op, negated_mask(in), in);
+      }
+      return operation_mask(op, types::before(it.at, stmt[0]), types::before(it.at, stmt[1]));
+   }
+   switch (op) {
+      case lexer::stack:
+         return types::before(it.at, stmt[0]);
+      case lexer::cast:
+         return cast_mask(any_cast<data_type_e>(stmt[2].data), types::before(it.at, stmt[0]));
+      case lexer::read:
+         return types::of(data_type_e::str);
+      case lexer::receive:
+      case lexer::resume:
+         return types::any;
+      case lexer::coroutine:
+         return types::of(data_type_e::integer);
+      case lexer::done:
+         return types::of(data_type_e::chr);
+      case lexer::map:
+         return types::of(data_type_e::array);
+      case lexer::reduce:
+         return reduced_mask(any_cast<reduce::kind_e>(stmt[2].data));
+      case lexer::push:
+         return types::blank;
+      case lexer::pop: {
+         // a pop uncovering a value pushed over in the same block shares its number
+         types::mask_t out = 0;
+         bool uncovered = false;
+         for (u32 other : byVn.at(it.vn)) {
+            ref(statement_t) from = statements[ir::program.values[other].at];
+            if (ir::program.values[other].kind != ir::defined || from[from.size() - 1].type != lexer::pop) {
+               out |= types::values[other];
+               uncovered = true;
+            }
+         }
+         return uncovered ? out : types::any;
+      }
+      default:
+         return types::any;
+   }
+}
+
+void types::infer() {
+   ir::build();
+   u32 count = ir::program.values.size();
+   values.assign(count, 0);
+   numbered_t byVn;
+   for (u32 v = 0; v < count; v++) {
+      byVn[ir::program.values[v].vn].push_back(v);
+   }
+   for (bool changed = true; changed;) {
+      changed = false;
+      for (u32 v = 0; v < count; v++) {
+         ref(ir::value_t) it = ir::program.values[v];
+         mask_t mask = 0;
+         switch (it.kind) {
+            case ir::unknown:
+               mask = any;
+               break;
+            case ir::phi:
+               for (u32 arg : it.args) {
+                  mask |= arg == ir::none ? any : values[arg];
+               }
+               break;
+            case ir::defined:
+               mask = defined_mask(v, byVn);
+               break;
+         }
+         mask |= values[v];
+         if (mask != values[v]) {
+            values[v] = mask;
+            changed = true;
+         }
+      }
+   }
+}